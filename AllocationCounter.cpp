@@ -0,0 +1,132 @@
+#include "AllocationCounter.h"
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Shared totals, only kept after countGlobalAllocations() so the live program never contends on them
+std::atomic<bool> globalCounting(false);
+std::atomic<uint64_t> allocationTotal(0);
+std::atomic<uint64_t> byteTotal(0);
+
+// Constant-initialized, so using them inside operator new never allocates
+thread_local uint64_t threadAllocations = 0;
+thread_local uint64_t threadBytes = 0;
+
+void countAllocation(size_t size) {
+    threadAllocations++;
+    threadBytes += size;
+    if (globalCounting.load(std::memory_order_relaxed)) {
+        allocationTotal.fetch_add(1, std::memory_order_relaxed);
+        byteTotal.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+void* allocate(size_t size) {
+    countAllocation(size);
+    return std::malloc(size ? size : 1);
+}
+
+void* allocateAligned(size_t size, std::align_val_t alignment) {
+    countAllocation(size);
+    size_t align = static_cast<size_t>(alignment);
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, align);
+#else
+    void* p = nullptr;
+    return posix_memalign(&p, align < sizeof(void*) ? sizeof(void*) : align, size ? size : 1) == 0 ? p : nullptr;
+#endif
+}
+
+void freeAligned(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+// Counts Mat buffers and leaves the actual allocation to OpenCV's standard allocator
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override {
+        cv::UMatData* u = base->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        if (u && !data) {
+            countAllocation(u->size);
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData* u, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override {
+        return base->allocate(u, accessFlags, usageFlags);
+    }
+
+    // Buffers are released through their own allocator (the standard one), so this is only a fallback
+    void deallocate(cv::UMatData* u) const override {
+        base->deallocate(u);
+    }
+
+private:
+    const cv::MatAllocator* base = cv::Mat::getStdAllocator();
+};
+
+} // namespace
+
+AllocationCount allocationCount() {
+    return { allocationTotal.load(std::memory_order_relaxed), byteTotal.load(std::memory_order_relaxed) };
+}
+
+AllocationCount threadAllocationCount() {
+    return { threadAllocations, threadBytes };
+}
+
+void countGlobalAllocations() {
+    globalCounting.store(true, std::memory_order_relaxed);
+}
+
+void countMatAllocations() {
+    static CountingMatAllocator allocator;
+    cv::Mat::setDefaultAllocator(&allocator);
+}
+
+// Replacements of the global allocation functions; they only add to the counters above
+void* operator new(size_t size) {
+    if (void* p = allocate(size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    if (void* p = allocate(size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    if (void* p = allocateAligned(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    if (void* p = allocateAligned(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { freeAligned(p); }
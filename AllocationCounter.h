@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+
+// Heap allocations and bytes, for all threads or for one
+struct AllocationCount {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+
+    AllocationCount operator-(const AllocationCount& other) const {
+        return { allocations - other.allocations, bytes - other.bytes };
+    }
+};
+
+// Current totals, counted from the first countGlobalAllocations() call. Every operator new is counted;
+// cv::Mat buffers only after countMatAllocations().
+AllocationCount allocationCount();
+
+// Start keeping the totals over all threads. Each allocation then also adds to two shared atomics,
+// so only the benchmarks turn this on; the live program uses the per-thread counts.
+void countGlobalAllocations();
+
+// Totals of the calling thread only, so a stage can count its own allocations while other stages run.
+// Work OpenCV spreads over its own thread pool is counted on those threads.
+AllocationCount threadAllocationCount();
+
+// Route cv::Mat buffer allocations through the counter as well, since OpenCV does not use operator new for them
+void countMatAllocations();
@@ -0,0 +1,135 @@
+#include "BatchCalibration.h"
+#include "CameraCalibration.h"
+#include "CalibrationFile.h"
+#include "BundleAdjustment.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <cctype>
+
+std::vector<std::string> listImageFiles(const std::string& directory) {
+    std::vector<std::string> paths;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        if (!entry.is_regular_file()) continue;
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+        if (extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".bmp" || extension == ".tif" || extension == ".tiff") {
+            paths.push_back(entry.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+std::vector<BatchImageResult> detectBoardsInImages(const std::vector<std::string>& imagePaths, const cv::Size& patternSize) {
+    std::vector<BatchImageResult> results(imagePaths.size());
+
+    // Each image is independent, so the detections are spread over OpenCV's thread pool
+    cv::parallel_for_(cv::Range(0, int(imagePaths.size())), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            BatchImageResult& result = results[i];
+            result.path = imagePaths[i];
+            cv::Mat gray = cv::imread(result.path, cv::IMREAD_GRAYSCALE);
+            if (gray.empty()) {
+                result.rejectReason = "unreadable";
+                continue;
+            }
+            result.imageSize = gray.size();
+
+            auto start = std::chrono::steady_clock::now();
+            bool found = cv::findChessboardCorners(gray, patternSize, result.corners);
+            if (found) {
+                cv::cornerSubPix(gray, result.corners, cv::Size(11, 11), cv::Size(-1, -1),
+                    cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::MAX_ITER, 30, 0.1));
+            }
+            result.detectMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            result.accepted = found;
+            if (!found) {
+                result.rejectReason = "board not found";
+            }
+        }
+    });
+    return results;
+}
+
+bool runBatchCalibration(const std::string& imageDirectory, const cv::Size& patternSize, const std::string& outputPath) {
+    std::vector<std::string> imagePaths = listImageFiles(imageDirectory);
+    if (imagePaths.empty()) {
+        std::cerr << "No images found in " << imageDirectory << std::endl;
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BatchImageResult> results = detectBoardsInImages(imagePaths, patternSize);
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // All views must share one resolution; the first accepted image decides it
+    cv::Size imageSize;
+    for (BatchImageResult& result : results) {
+        if (!result.accepted) continue;
+        if (imageSize.area() == 0) {
+            imageSize = result.imageSize;
+        }
+        else if (result.imageSize != imageSize) {
+            result.accepted = false;
+            result.rejectReason = "resolution differs";
+        }
+    }
+
+    std::vector<std::vector<cv::Point2f>> corner_list;
+    const std::vector<cv::Vec3f> objectPoints = boardObjectPoints(patternSize);
+    double totalDetectMs = 0.0;
+    std::cout << std::fixed << std::setprecision(2);
+    for (const BatchImageResult& result : results) {
+        totalDetectMs += result.detectMs;
+        std::cout << "  " << std::setw(9) << result.detectMs << " ms  " << (result.accepted ? "accepted  " : "REJECTED  ")
+            << std::filesystem::path(result.path).filename().string();
+        if (!result.accepted) {
+            std::cout << " (" << result.rejectReason << ")";
+        }
+        std::cout << std::endl;
+        if (result.accepted) {
+            corner_list.push_back(result.corners);
+        }
+    }
+    std::cout << "Detected boards in " << corner_list.size() << " of " << results.size() << " images in " << wallMs
+        << " ms wall time (" << totalDetectMs << " ms of detection, " << cv::getNumThreads() << " threads)" << std::endl;
+    std::cout << std::defaultfloat;
+
+    if (corner_list.size() < 5) {
+        std::cerr << "Not enough calibration images. Need at least 5." << std::endl;
+        return false;
+    }
+
+    // cv::calibrateCamera on a few evenly spread views gives the starting point; the bundle adjustment then refines
+    // it over every view, with its cost growing linearly in the view count, and rejects views that do not fit
+    const size_t seedViews = 20;
+    std::vector<std::vector<cv::Point2f>> seedCorners;
+    std::vector<std::vector<cv::Vec3f>> seedPoints;
+    for (size_t i = 0; i < std::min(seedViews, corner_list.size()); ++i) {
+        seedCorners.push_back(corner_list[i * corner_list.size() / std::min(seedViews, corner_list.size())]);
+        seedPoints.push_back(objectPoints);
+    }
+    CalibrationData calibration;
+    calibration.imageSize = imageSize;
+    calibrateCamera(seedCorners, seedPoints, imageSize, calibration.cameraMatrix, calibration.distCoeffs, cv::CALIB_FIX_ASPECT_RATIO);
+
+    BundleAdjustmentOptions options;
+    options.fixAspectRatio = true;
+    BundleAdjustmentResult refined;
+    if (!bundleAdjustCalibration(corner_list, objectPoints, imageSize, calibration.cameraMatrix, calibration.distCoeffs, refined, options)) {
+        return false;
+    }
+    printBundleAdjustmentResult(refined);
+    calibration.rms = refined.rms;
+    calibration.perViewErrors = refined.perViewErrors;
+    if (!saveCalibration(outputPath, calibration)) {
+        std::cerr << "Failed to save calibration data." << std::endl;
+        return false;
+    }
+    std::cout << "Calibration data saved to " << outputPath << std::endl;
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Detection outcome for one stored capture
+struct BatchImageResult {
+    std::string path;
+    bool accepted = false;
+    std::string rejectReason;
+    double detectMs = 0.0;
+    cv::Size imageSize;
+    std::vector<cv::Point2f> corners;
+};
+
+// Detect the chessboard in every image of a directory in parallel, calibrate from the accepted views,
+// and write the result with saveCalibration. Returns false if calibration could not run.
+bool runBatchCalibration(const std::string& imageDirectory, const cv::Size& patternSize, const std::string& outputPath);
+
+// Parallel detection step of runBatchCalibration, one result per image in sorted path order
+std::vector<BatchImageResult> detectBoardsInImages(const std::vector<std::string>& imagePaths, const cv::Size& patternSize);
+
+// Image files (jpg, jpeg, png, bmp, tif, tiff) in a directory, sorted by name
+std::vector<std::string> listImageFiles(const std::string& directory);
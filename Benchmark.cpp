@@ -0,0 +1,689 @@
+#include "Benchmark.h"
+#include "ModelLoader.h"
+#include "MeshSimplification.h"
+#include "CalibrationFile.h"
+#include "UndistortionCache.h"
+#include "VertexProjector.h"
+#include "CameraCalibration.h"
+#include "FeatureDetection.h"
+#include "ChessboardDetection.h"
+#include "BatchCalibration.h"
+#include "BundleAdjustment.h"
+#include "AllocationCounter.h"
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cmath>
+
+namespace {
+
+struct TimingSummary {
+    double meanMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+};
+
+// Run a function several times and summarize its wall time
+TimingSummary timeRuns(int iterations, const std::function<void()>& run) {
+    TimingSummary summary;
+    summary.minMs = 1e300;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        summary.meanMs += ms / iterations;
+        summary.minMs = std::min(summary.minMs, ms);
+        summary.maxMs = std::max(summary.maxMs, ms);
+    }
+    return summary;
+}
+
+// Number of cells in a grid over the image that contain at least one keypoint
+int occupiedCells(const std::vector<cv::KeyPoint>& keypoints, cv::Size imageSize, cv::Size grid) {
+    std::vector<char> occupied(size_t(grid.area()), 0);
+    for (const cv::KeyPoint& keypoint : keypoints) {
+        int gx = std::min(int(keypoint.pt.x) * grid.width / imageSize.width, grid.width - 1);
+        int gy = std::min(int(keypoint.pt.y) * grid.height / imageSize.height, grid.height - 1);
+        occupied[gy * grid.width + gx] = 1;
+    }
+    return int(std::count(occupied.begin(), occupied.end(), 1));
+}
+
+// Latency samples and allocations of one replayed stage
+struct ReplayStage {
+    std::string name;
+    std::vector<double> samplesMs;
+    AllocationCount allocations;
+};
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = size_t(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// Frames of one replay input: a directory of images (preferring frame_* files), one image, or a video
+bool loadReplayFrames(const std::string& input, int maxVideoFrames, std::vector<cv::Mat>& frames) {
+    std::error_code error;
+    if (std::filesystem::is_directory(input, error)) {
+        std::vector<std::string> paths = listImageFiles(input), sequence;
+        for (const std::string& path : paths) {
+            if (std::filesystem::path(path).filename().string().rfind("frame_", 0) == 0) sequence.push_back(path);
+        }
+        for (const std::string& path : sequence.empty() ? paths : sequence) {
+            cv::Mat frame = cv::imread(path, cv::IMREAD_COLOR);
+            if (!frame.empty()) frames.push_back(frame);
+        }
+        return !frames.empty();
+    }
+    cv::Mat image = cv::imread(input, cv::IMREAD_COLOR);
+    if (!image.empty()) {
+        frames.push_back(image);
+        return true;
+    }
+    cv::VideoCapture video(input);
+    cv::Mat frame;
+    while (video.isOpened() && int(frames.size()) < maxVideoFrames && video.read(frame)) {
+        frames.push_back(frame.clone());
+    }
+    return !frames.empty();
+}
+
+void printTiming(const std::string& label, const TimingSummary& timing) {
+    std::cout << std::fixed << std::setprecision(2) << "  " << std::left << std::setw(28) << label << std::right
+        << " mean " << std::setw(10) << timing.meanMs << " ms, min " << std::setw(10) << timing.minMs
+        << " ms, max " << std::setw(10) << timing.maxMs << " ms" << std::endl << std::defaultfloat;
+}
+
+// Unit sphere of stacks x slices quads split into triangles, with one vertex at each pole
+void buildSphereMesh(int stacks, int slices, Mesh& mesh) {
+    mesh = Mesh();
+    auto addVertex = [&](double x, double y, double z) {
+        mesh.px.push_back(float(x));
+        mesh.py.push_back(float(y));
+        mesh.pz.push_back(float(z));
+    };
+    addVertex(0.0, 0.0, 1.0);
+    for (int i = 1; i < stacks; ++i) {
+        double theta = CV_PI * i / stacks;
+        for (int j = 0; j < slices; ++j) {
+            double phi = 2.0 * CV_PI * j / slices;
+            addVertex(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+        }
+    }
+    addVertex(0.0, 0.0, -1.0);
+    const int south = int(mesh.vertexCount()) - 1;
+    auto ring = [&](int i, int j) { return 1 + (i - 1) * slices + j % slices; };
+    auto addTriangle = [&](int a, int b, int c) {
+        for (int v : { a, b, c }) {
+            mesh.cornerVertices.push_back(v);
+            mesh.cornerTextures.push_back(-1);
+            mesh.cornerNormals.push_back(-1);
+        }
+        mesh.faceOffsets.push_back(uint32_t(mesh.cornerVertices.size()));
+    };
+    mesh.faceOffsets.push_back(0);
+    for (int j = 0; j < slices; ++j) {
+        addTriangle(0, ring(1, j), ring(1, j + 1));
+        addTriangle(south, ring(stacks - 1, j + 1), ring(stacks - 1, j));
+    }
+    for (int i = 1; i + 1 < stacks; ++i) {
+        for (int j = 0; j < slices; ++j) {
+            addTriangle(ring(i, j), ring(i + 1, j), ring(i + 1, j + 1));
+            addTriangle(ring(i, j), ring(i + 1, j + 1), ring(i, j + 1));
+        }
+    }
+    buildEdgeList(mesh);
+}
+
+// Largest distance of a triangle centroid from the unit sphere
+double maxSphereDeviation(const Mesh& mesh) {
+    double deviation = 0.0;
+    for (size_t f = 0; f < mesh.faceCount(); ++f) {
+        cv::Vec3d centroid;
+        for (uint32_t c = mesh.faceOffsets[f]; c < mesh.faceOffsets[f + 1]; ++c) {
+            int v = mesh.cornerVertices[c];
+            centroid += cv::Vec3d(mesh.px[v], mesh.py[v], mesh.pz[v]);
+        }
+        centroid *= 1.0 / (mesh.faceOffsets[f + 1] - mesh.faceOffsets[f]);
+        deviation = std::max(deviation, std::abs(cv::norm(centroid) - 1.0));
+    }
+    return deviation;
+}
+
+} // namespace
+
+bool checkMeshSimplification() {
+    Mesh sphere;
+    buildSphereMesh(80, 120, sphere);
+    std::cout << "Simplification check: unit sphere with " << triangleCount(sphere) << " triangles" << std::endl;
+
+    // An even tessellation with T triangles keeps its centroids about 8 pi / (3 sqrt(3) T) inside the sphere.
+    // Collapses taken in cheapest-first order stay within twice that; out-of-order collapses do not.
+    bool passed = true;
+    std::cout << "   target   reached   max deviation   limit" << std::endl;
+    for (size_t target : { size_t(2000), size_t(948), size_t(300) }) {
+        Mesh simplified;
+        simplifyMesh(sphere, target, simplified);
+        size_t reached = triangleCount(simplified);
+        double deviation = maxSphereDeviation(simplified);
+        double limit = 2.0 * 8.0 * CV_PI / (3.0 * std::sqrt(3.0) * target);
+        bool ok = reached <= target && deviation <= limit;
+        passed = passed && ok;
+        std::cout << std::fixed << std::setprecision(4) << std::setw(9) << target << std::setw(10) << reached
+            << std::setw(16) << deviation << std::setw(8) << limit << (ok ? "" : "   FAILED") << std::endl << std::defaultfloat;
+    }
+    std::cout << (passed ? "Simplification check passed" : "Simplification check FAILED") << std::endl;
+    return passed;
+}
+
+void benchmarkModelLoad(const std::string& objPath, int iterations) {
+    iterations = std::max(iterations, 1);
+    std::vector<Vertex> vertices;
+    std::vector<TextureCoord> textures;
+    std::vector<Normal> normals;
+    std::vector<Face> faces;
+    auto clearModel = [&] {
+        vertices.clear();
+        textures.clear();
+        normals.clear();
+        faces.clear();
+    };
+
+    if (!loadOBJModel(objPath, vertices, textures, normals, faces, false)) {
+        return;
+    }
+    std::cout << "Model load benchmark: " << objPath << " (" << vertices.size() << " vertices, " << faces.size()
+        << " faces, " << iterations << " runs)" << std::endl;
+
+    printTiming("reference stream parser", timeRuns(iterations, [&] {
+        clearModel();
+        loadOBJModelReference(objPath, vertices, textures, normals, faces);
+    }));
+    printTiming("memory-mapped parser", timeRuns(iterations, [&] {
+        clearModel();
+        loadOBJModel(objPath, vertices, textures, normals, faces, false);
+    }));
+
+    // The first cached load writes the cache, every later one reads it
+    std::remove((objPath + ".meshcache").c_str());
+    printTiming("first load (writes cache)", timeRuns(1, [&] {
+        clearModel();
+        loadOBJModel(objPath, vertices, textures, normals, faces);
+    }));
+    printTiming("cached load", timeRuns(iterations, [&] {
+        clearModel();
+        loadOBJModel(objPath, vertices, textures, normals, faces);
+    }));
+
+    // The flat mesh skips the per-face vectors entirely
+    Mesh mesh;
+    printTiming("flat mesh, parser", timeRuns(iterations, [&] {
+        loadOBJMesh(objPath, mesh, false, false);
+    }));
+    printTiming("flat mesh, cached load", timeRuns(iterations, [&] {
+        loadOBJMesh(objPath, mesh);
+    }));
+
+    size_t cornerEdges = mesh.cornerVertices.size();
+    std::cout << "  memory: per-face vectors " << legacyModelBytes(vertices, textures, normals, faces) / 1024
+        << " KiB, flat mesh " << mesh.memoryBytes() / 1024 << " KiB" << std::endl;
+    std::cout << "  wireframe: " << cornerEdges << " lines drawn per face, " << mesh.edgeCount() << " unique edges" << std::endl;
+}
+
+void benchmarkUndistortion(const std::string& calibrationPath, int iterations) {
+    iterations = std::max(iterations, 1);
+    CalibrationData calibration;
+    if (!loadCalibration(calibrationPath, calibration)) {
+        return;
+    }
+    cv::Size imageSize = calibration.imageSize.area() > 0 ? calibration.imageSize : cv::Size(640, 480);
+    const cv::Mat& K = calibration.cameraMatrix;
+    const cv::Mat& D = calibration.distCoeffs;
+    std::cout << "Undistortion benchmark: " << imageSize.width << "x" << imageSize.height << ", " << D.total()
+        << " distortion coefficients, " << iterations << " runs" << std::endl;
+
+    cv::Mat frame(imageSize, CV_8UC3), undistorted;
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    // Per-frame cost of the three ways to undistort
+    printTiming("cv::undistort (maps per call)", timeRuns(iterations, [&] {
+        cv::undistort(frame, undistorted, K, D);
+    }));
+    cv::Mat floatMapX, floatMapY;
+    cv::initUndistortRectifyMap(K, D, cv::Mat(), K, imageSize, CV_32FC1, floatMapX, floatMapY);
+    printTiming("remap, float maps", timeRuns(iterations, [&] {
+        cv::remap(frame, undistorted, floatMapX, floatMapY, cv::INTER_LINEAR);
+    }));
+    UndistortionCache cache;
+    printTiming("fixed-point map build", timeRuns(1, [&] {
+        cache.update(K, D, imageSize);
+    }));
+    printTiming("cached fixed-point remap", timeRuns(iterations, [&] {
+        cache.update(K, D, imageSize);
+        cache.apply(frame, undistorted);
+    }));
+    std::cout << "  maps built " << cache.stats().rebuilds << " time(s) for " << iterations + 1 << " updates" << std::endl;
+
+    // What removing the distortion terms saves on the calls made for every frame
+    cv::Size patternSize(9, 6);
+    std::vector<cv::Vec3f> objectPoints = boardObjectPoints(patternSize);
+    cv::Mat rvec = (cv::Mat_<double>(3, 1) << 0.2, -0.3, 0.1), tvec = (cv::Mat_<double>(3, 1) << -4.0, -3.0, 20.0);
+    std::vector<cv::Point2f> corners;
+    cv::projectPoints(objectPoints, rvec, tvec, K, D, corners);
+    const cv::Mat noDistortion;
+    cv::Mat r, t;
+    printTiming("solvePnP, distorted", timeRuns(iterations, [&] {
+        cv::solvePnP(objectPoints, corners, K, D, r, t);
+    }));
+    printTiming("solvePnP, undistorted", timeRuns(iterations, [&] {
+        cv::solvePnP(objectPoints, corners, K, noDistortion, r, t);
+    }));
+
+    // A dense grid stands in for a large model; the projector's pose cache is bypassed by nudging the pose
+    std::vector<Vertex> vertices;
+    for (int i = 0; i < 100000; ++i) {
+        vertices.push_back({ float(i % 320) / 40.0f, float(i / 320) / 40.0f, -float(i % 7) * 0.1f });
+    }
+    VertexProjector projector;
+    projector.setVertices(vertices);
+    auto timeProjection = [&](const cv::Mat& distortion) {
+        return timeRuns(iterations, [&] {
+            tvec.at<double>(2) += 1e-3;
+            projector.project(rvec, tvec, K, distortion);
+        });
+    };
+    printTiming("100k vertices, distorted", timeProjection(D));
+    printTiming("100k vertices, undistorted", timeProjection(noDistortion));
+}
+
+void benchmarkFeatureDetection(int iterations) {
+    iterations = std::max(iterations, 1);
+    std::cout << "Feature detection benchmark (" << iterations << " runs per resolution)" << std::endl;
+
+    const cv::Size resolutions[] = { cv::Size(320, 240), cv::Size(640, 480), cv::Size(1280, 720), cv::Size(1920, 1080) };
+    for (const cv::Size& size : resolutions) {
+        // Textured background with a chessboard-like block in one corner, so features would cluster without the grid
+        cv::Mat frame(size, CV_8UC3), scratch;
+        cv::randu(frame, cv::Scalar::all(90), cv::Scalar::all(130));
+        cv::GaussianBlur(frame, frame, cv::Size(5, 5), 2.0);
+        int square = std::max(size.width / 40, 4);
+        for (int y = 0; y < size.height / 2; y += square) {
+            for (int x = 0; x < size.width / 2; x += square) {
+                if (((x + y) / square) % 2 == 0) cv::rectangle(frame, cv::Rect(x, y, square, square), cv::Scalar::all(255), cv::FILLED);
+            }
+        }
+        std::cout << " " << size.width << "x" << size.height << std::endl;
+
+        auto printThroughput = [&](const std::string& label, const TimingSummary& timing) {
+            printTiming(label, timing);
+            std::cout << "    " << std::fixed << std::setprecision(1) << 1000.0 / std::max(timing.meanMs, 1e-6) << " frames/s" << std::endl << std::defaultfloat;
+        };
+
+        // The per-call functions draw onto the frame, so each run works on a fresh copy
+        printThroughput("ORB, per call", timeRuns(iterations, [&] {
+            frame.copyTo(scratch);
+            detectAndDrawFeatures(scratch);
+        }));
+        FeatureDetector orbDetector(FeatureType::ORB);
+        printThroughput("ORB, grid detector", timeRuns(iterations, [&] {
+            frame.copyTo(scratch);
+            drawFeatures(scratch, orbDetector.detect(scratch), FeatureType::ORB);
+        }));
+        printThroughput("Harris, per call", timeRuns(iterations, [&] {
+            frame.copyTo(scratch);
+            detectHarrisCorners(scratch);
+        }));
+        FeatureDetector harrisDetector(FeatureType::Harris);
+        printThroughput("Harris, grid detector", timeRuns(iterations, [&] {
+            frame.copyTo(scratch);
+            drawFeatures(scratch, harrisDetector.detect(scratch), FeatureType::Harris);
+        }));
+
+        // How evenly the keypoints cover the image, measured on the detector's own grid
+        std::vector<cv::KeyPoint> wholeImage;
+        cv::ORB::create()->detect(frame, wholeImage);
+        const std::vector<cv::KeyPoint>& gridded = orbDetector.detect(frame);
+        cv::Size grid = orbDetector.gridSize();
+        std::cout << "  ORB coverage: per call " << wholeImage.size() << " keypoints in " << occupiedCells(wholeImage, size, grid) << " of " << grid.area()
+            << " cells, grid detector " << gridded.size() << " keypoints in " << occupiedCells(gridded, size, grid) << " cells" << std::endl;
+    }
+}
+
+void benchmarkBundleAdjustment(int maxViews, int compareLimit) {
+    const cv::Size patternSize(9, 6), imageSize(640, 480);
+    const std::vector<cv::Vec3f> objectPoints = boardObjectPoints(patternSize);
+    const cv::Matx33d trueK(800.0, 0.0, 320.0, 0.0, 800.0, 240.0, 0.0, 0.0, 1.0);
+    const cv::Vec<double, 5> trueD(-0.2, 0.08, 0.001, -0.0005, 0.0);
+    std::cout << "Bundle adjustment benchmark: synthetic " << patternSize.width << "x" << patternSize.height << " board views, 0.3 px corner noise, "
+        << "every 50th view corrupted by up to 5 px, " << cv::getNumThreads() << " threads" << std::endl;
+
+    // Random board poses whose corners all stay inside the image
+    cv::RNG rng(5330);
+    std::vector<std::vector<cv::Point2f>> allCorners;
+    while (int(allCorners.size()) < maxViews) {
+        cv::Vec3d rvec(rng.uniform(-0.6, 0.6), rng.uniform(-0.6, 0.6), rng.uniform(-0.3, 0.3));
+        cv::Vec3d tvec(rng.uniform(-7.0, 0.0), rng.uniform(0.0, 5.0), rng.uniform(14.0, 28.0));
+        std::vector<cv::Point2f> corners;
+        cv::projectPoints(objectPoints, rvec, tvec, trueK, trueD, corners);
+        bool inside = true;
+        for (const cv::Point2f& corner : corners) {
+            inside = inside && corner.x >= 0 && corner.y >= 0 && corner.x < imageSize.width && corner.y < imageSize.height;
+        }
+        if (!inside) continue;
+        bool corrupted = allCorners.size() % 50 == 25;
+        for (cv::Point2f& corner : corners) {
+            corner.x += float(rng.gaussian(0.3) + (corrupted ? rng.uniform(-5.0, 5.0) : 0.0));
+            corner.y += float(rng.gaussian(0.3) + (corrupted ? rng.uniform(-5.0, 5.0) : 0.0));
+        }
+        allCorners.push_back(std::move(corners));
+    }
+
+    std::cout << "   views   parallel ms     serial ms   iterations   rejected   rms px   fx error | calibrateCamera ms   rms px   fx error" << std::endl;
+    for (int views : { 10, 30, 100, 300, 1000 }) {
+        if (views > maxViews) break;
+        std::vector<std::vector<cv::Point2f>> corner_list(allCorners.begin(), allCorners.begin() + views);
+
+        BundleAdjustmentOptions options;
+        BundleAdjustmentResult parallelResult, serialResult;
+        cv::Mat K, D, serialK, serialD;
+        bundleAdjustCalibration(corner_list, objectPoints, imageSize, K, D, parallelResult, options);
+        options.parallel = false;
+        bundleAdjustCalibration(corner_list, objectPoints, imageSize, serialK, serialD, serialResult, options);
+
+        std::cout << std::fixed << std::setprecision(2) << std::setw(8) << views
+            << std::setw(14) << parallelResult.initMs + parallelResult.solveMs << std::setw(14) << serialResult.initMs + serialResult.solveMs
+            << std::setw(13) << parallelResult.iterations << std::setw(11) << parallelResult.rejectedViews
+            << std::setw(9) << parallelResult.rms << std::setw(10) << K.at<double>(0, 0) - trueK(0, 0) << " |";
+        if (views <= compareLimit) {
+            std::vector<std::vector<cv::Vec3f>> point_list(views, objectPoints);
+            cv::Mat cvK, cvD;
+            std::vector<cv::Mat> rvecs, tvecs;
+            auto start = std::chrono::steady_clock::now();
+            double rms = cv::calibrateCamera(point_list, corner_list, imageSize, cvK, cvD, rvecs, tvecs);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << std::setw(19) << ms << std::setw(9) << rms << std::setw(11) << cvK.at<double>(0, 0) - trueK(0, 0);
+        }
+        else {
+            std::cout << std::setw(19) << "skipped";
+        }
+        std::cout << std::endl << std::defaultfloat;
+    }
+}
+
+bool benchmarkBoardDetectors(const std::vector<std::string>& inputs, const std::string& calibrationPath, int passes) {
+    passes = std::max(passes, 1);
+    const cv::Size patternSize(9, 6);
+    std::vector<cv::Mat> frames;
+    for (const std::string& input : inputs.empty() ? std::vector<std::string>{ "res", "res/Task2", "res/Task3" } : inputs) {
+        if (!loadReplayFrames(input, 300, frames)) {
+            std::cerr << "Warning: no frames read from " << input << std::endl;
+        }
+    }
+    if (frames.empty()) {
+        std::cerr << "Error: no frames to run the detectors on." << std::endl;
+        return false;
+    }
+    // Every backend starts from the same grayscale frames, so the conversion stays out of the timings
+    std::vector<cv::Mat> grays(frames.size());
+    for (size_t i = 0; i < frames.size(); ++i) {
+        cv::cvtColor(frames[i], grays[i], cv::COLOR_BGR2GRAY);
+    }
+
+    // Lens distortion is removed before the grid fit when a calibration is available
+    CalibrationData calibration;
+    std::string path = calibrationPath.empty()
+        ? (std::filesystem::exists("res/calibration.calib") ? "res/calibration.calib" : "res/calibration_data.csv") : calibrationPath;
+    bool undistort = loadCalibration(path, calibration);
+    if (!undistort) {
+        std::cerr << "Warning: no calibration, so the grid fit includes lens distortion." << std::endl;
+    }
+    std::vector<cv::Point2f> grid;
+    for (const cv::Vec3f& point : boardObjectPoints(patternSize)) {
+        grid.push_back(cv::Point2f(point[0], point[1]));
+    }
+    auto gridResidual = [&](const std::vector<cv::Point2f>& corners) {
+        std::vector<cv::Point2f> points = corners, expected;
+        if (undistort) {
+            cv::undistortPoints(corners, points, calibration.cameraMatrix, calibration.distCoeffs, cv::noArray(), calibration.cameraMatrix);
+        }
+        cv::Mat H = cv::findHomography(grid, points);
+        if (H.empty()) return -1.0;
+        cv::perspectiveTransform(grid, expected, H);
+        double squared = 0.0;
+        for (size_t i = 0; i < points.size(); ++i) {
+            cv::Point2f d = points[i] - expected[i];
+            squared += d.x * d.x + d.y * d.y;
+        }
+        return std::sqrt(squared / points.size());
+    };
+    // The board looks the same turned half way round, so detectors may list the corners in either order
+    auto meanDistance = [](const std::vector<cv::Point2f>& a, const std::vector<cv::Point2f>& b) {
+        double forward = 0.0, reversed = 0.0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            forward += cv::norm(a[i] - b[i]);
+            reversed += cv::norm(a[i] - b[b.size() - 1 - i]);
+        }
+        return std::min(forward, reversed) / a.size();
+    };
+
+    // The classic detector's corners are the reference the others are compared with
+    std::vector<std::vector<cv::Point2f>> reference(frames.size());
+    BoardDetector classic(patternSize);
+    for (size_t i = 0; i < grays.size(); ++i) {
+        if (!classic.detect(grays[i], reference[i])) reference[i].clear();
+    }
+
+    std::cout << "Board detector benchmark: " << frames.size() << " frames x " << passes << " passes, " << patternSize.width << "x" << patternSize.height << " board" << std::endl;
+    std::cout << "  backend      mean ms    p50 ms    p90 ms    max ms    found   prechecked out   grid rms px   vs classic px" << std::endl;
+    for (BoardDetectorBackend backend : { BoardDetectorBackend::Classic, BoardDetectorBackend::ClassicFast, BoardDetectorBackend::Sector, BoardDetectorBackend::Precheck }) {
+        BoardDetector detector(patternSize, backend);
+        std::vector<double> samples;
+        std::vector<cv::Point2f> corners;
+        int found = 0, compared = 0, fitted = 0;
+        double residualTotal = 0.0, distanceTotal = 0.0;
+
+        // Pass 0 warms up and is not recorded; accuracy is taken from the last pass
+        for (int pass = 0; pass <= passes; ++pass) {
+            for (size_t i = 0; i < grays.size(); ++i) {
+                auto start = std::chrono::steady_clock::now();
+                bool ok = detector.detect(grays[i], corners);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (pass == 0) continue;
+                samples.push_back(ms);
+                if (pass < passes || !ok) continue;
+                found++;
+                double residual = gridResidual(corners);
+                if (residual >= 0.0) {
+                    residualTotal += residual;
+                    fitted++;
+                }
+                if (!reference[i].empty() && reference[i].size() == corners.size()) {
+                    distanceTotal += meanDistance(corners, reference[i]);
+                    compared++;
+                }
+            }
+        }
+
+        std::sort(samples.begin(), samples.end());
+        double mean = 0.0;
+        for (double ms : samples) mean += ms / samples.size();
+        std::cout << std::fixed << std::setprecision(3) << "  " << std::left << std::setw(10) << boardDetectorName(backend) << std::right
+            << std::setw(10) << mean << std::setw(10) << percentile(samples, 50) << std::setw(10) << percentile(samples, 90)
+            << std::setw(10) << samples.back() << std::setw(6) << found << "/" << std::left << std::setw(5) << frames.size() << std::right
+            << std::setw(14) << detector.stats().prechecksRejected / (passes + 1)
+            << std::setw(14) << (fitted > 0 ? residualTotal / fitted : 0.0)
+            << std::setw(16) << (compared > 0 ? distanceTotal / compared : 0.0) << std::endl << std::defaultfloat;
+    }
+    return true;
+}
+
+bool runReplayBenchmark(const ReplayOptions& options) {
+    countGlobalAllocations();
+    countMatAllocations();
+    std::vector<std::string> inputs = options.inputs;
+    if (inputs.empty()) {
+        inputs = { "res", "res/Task2", "res/Task3" };
+    }
+
+    // Everything is decoded up front so disk and codec time stay out of the stage timings
+    std::vector<cv::Mat> frames;
+    std::vector<size_t> inputFrames;
+    for (const std::string& input : inputs) {
+        size_t before = frames.size();
+        if (!loadReplayFrames(input, options.maxVideoFrames, frames)) {
+            std::cerr << "Warning: no frames read from " << input << std::endl;
+        }
+        inputFrames.push_back(frames.size() - before);
+    }
+    if (frames.empty()) {
+        std::cerr << "Error: nothing to replay." << std::endl;
+        return false;
+    }
+
+    CalibrationData calibration;
+    std::string calibrationPath = options.calibrationPath;
+    if (calibrationPath.empty()) {
+        calibrationPath = std::filesystem::exists("res/calibration.calib") ? "res/calibration.calib" : "res/calibration_data.csv";
+    }
+    cv::Mat K, D;
+    if (loadCalibration(calibrationPath, calibration)) {
+        K = calibration.cameraMatrix;
+        D = calibration.distCoeffs;
+    }
+    else {
+        // A rough pinhole guess still exercises every stage
+        std::cerr << "Warning: using an approximate camera matrix without distortion." << std::endl;
+        double f = frames[0].cols;
+        K = (cv::Mat_<double>(3, 3) << f, 0, frames[0].cols / 2.0, 0, f, frames[0].rows / 2.0, 0, 0, 1);
+        D = cv::Mat::zeros(5, 1, CV_64F);
+    }
+
+    Mesh model;
+    VertexProjector projector;
+    bool hasModel = !options.modelPath.empty() && loadOBJMesh(options.modelPath, model);
+    if (hasModel) {
+        projector.setVertices(model);
+    }
+
+    cv::Size patternSize(9, 6);
+    std::vector<cv::Vec3f> objectPoints = boardObjectPoints(patternSize);
+    std::vector<cv::Point3f> axesPoints = { cv::Point3f(0, 0, 0), cv::Point3f(3, 0, 0), cv::Point3f(0, 3, 0), cv::Point3f(0, 0, -3) };
+    FeatureDetector featureDetector;
+    std::vector<ReplayStage> stages = { { "detect" }, { "pose" }, { "axes" }, { "model" }, { "features" } };
+    enum { Detect, Pose, Axes, Model, Features };
+
+    cv::Mat work, rvec, tvec;
+    std::vector<cv::Point2f> corners, axesImage;
+    int64_t boardsFound = 0;
+    double busyMs = 0.0;
+    auto wallStart = std::chrono::steady_clock::now();
+
+    // Pass 0 warms caches and OpenCV's thread pool and is not recorded
+    for (int pass = 0; pass <= std::max(options.passes, 1); ++pass) {
+        if (pass == 1) {
+            wallStart = std::chrono::steady_clock::now();
+        }
+        for (const cv::Mat& frame : frames) {
+            frame.copyTo(work);
+            bool found = false;
+            auto runStage = [&](int stage, const std::function<void()>& body) {
+                AllocationCount before = allocationCount();
+                auto start = std::chrono::steady_clock::now();
+                body();
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (pass > 0) {
+                    AllocationCount used = allocationCount() - before;
+                    stages[stage].samplesMs.push_back(ms);
+                    stages[stage].allocations.allocations += used.allocations;
+                    stages[stage].allocations.bytes += used.bytes;
+                    busyMs += ms;
+                }
+            };
+
+            runStage(Detect, [&] {
+                found = findChessboardCorners(work, patternSize, corners);
+                if (found) drawBoardCorners(work, patternSize, corners);
+            });
+            if (found) {
+                bool posed = false;
+                runStage(Pose, [&] { posed = cv::solvePnP(objectPoints, corners, K, D, rvec, tvec); });
+                if (posed) {
+                    runStage(Axes, [&] {
+                        cv::projectPoints(axesPoints, rvec, tvec, K, D, axesImage);
+                        cv::line(work, axesImage[0], axesImage[1], cv::Scalar(0, 0, 255), 3);
+                        cv::line(work, axesImage[0], axesImage[2], cv::Scalar(0, 255, 0), 3);
+                        cv::line(work, axesImage[0], axesImage[3], cv::Scalar(255, 0, 0), 3);
+                    });
+                    if (hasModel) {
+                        runStage(Model, [&] {
+                            const std::vector<cv::Point2f>& points = projector.project(rvec, tvec, K, D);
+                            for (const cv::Point2f& point : points) {
+                                cv::circle(work, point, 2, cv::Scalar(0, 255, 0), -1);
+                            }
+                            for (size_t i = 0; i < model.edges.size(); i += 2) {
+                                cv::line(work, points[model.edges[i]], points[model.edges[i + 1]], cv::Scalar(255, 0, 0), 1);
+                            }
+                        });
+                    }
+                }
+                boardsFound += pass > 0 ? 1 : 0;
+            }
+            runStage(Features, [&] { drawFeatures(work, featureDetector.detect(work), FeatureType::ORB); });
+        }
+    }
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    int64_t framesReplayed = int64_t(frames.size()) * std::max(options.passes, 1);
+
+    std::cout << "Replay benchmark: " << frames.size() << " frames x " << std::max(options.passes, 1) << " passes, board found in "
+        << boardsFound << " of " << framesReplayed << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::ofstream json(options.jsonPath, std::ios::trunc);
+    json << std::fixed << std::setprecision(4);
+    json << "{\n  \"format\": 1,\n  \"opencv\": " << jsonString(CV_VERSION) << ",\n  \"passes\": " << std::max(options.passes, 1) << ",\n  \"inputs\": [";
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        json << (i ? ", " : "") << "{ \"path\": " << jsonString(inputs[i]) << ", \"frames\": " << inputFrames[i] << " }";
+    }
+    json << "],\n  \"frames\": " << framesReplayed << ",\n  \"boards_found\": " << boardsFound
+        << ",\n  \"wall_seconds\": " << wallSeconds << ",\n  \"throughput_fps\": " << (busyMs > 0.0 ? framesReplayed * 1000.0 / busyMs : 0.0)
+        << ",\n  \"stages\": {";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        ReplayStage& stage = stages[i];
+        std::vector<double> sorted = stage.samplesMs;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double ms : sorted) total += ms;
+        size_t runs = sorted.size();
+        double mean = runs > 0 ? total / runs : 0.0;
+        json << (i ? "," : "") << "\n    " << jsonString(stage.name) << ": { \"runs\": " << runs << ", \"mean_ms\": " << mean
+            << ", \"p50_ms\": " << percentile(sorted, 50) << ", \"p90_ms\": " << percentile(sorted, 90) << ", \"p99_ms\": " << percentile(sorted, 99)
+            << ", \"max_ms\": " << (runs > 0 ? sorted.back() : 0.0)
+            << ", \"allocations_per_run\": " << (runs > 0 ? double(stage.allocations.allocations) / runs : 0.0)
+            << ", \"bytes_per_run\": " << (runs > 0 ? double(stage.allocations.bytes) / runs : 0.0) << " }";
+        std::cout << "  " << std::left << std::setw(9) << stage.name << std::right << " runs " << std::setw(6) << runs << "  mean " << std::setw(8) << mean
+            << " ms  p50 " << std::setw(8) << percentile(sorted, 50) << "  p99 " << std::setw(8) << percentile(sorted, 99)
+            << " ms  allocations/run " << (runs > 0 ? double(stage.allocations.allocations) / runs : 0.0) << std::endl;
+    }
+    json << "\n  }\n}\n";
+    std::cout << "  throughput " << (busyMs > 0.0 ? framesReplayed * 1000.0 / busyMs : 0.0) << " frames/s" << std::endl << std::defaultfloat;
+    if (!json.good()) {
+        std::cerr << "Error: could not write " << options.jsonPath << std::endl;
+        return false;
+    }
+    std::cout << "Results written to " << options.jsonPath << std::endl;
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Simplify a finely tessellated unit sphere to several triangle budgets and check that the results stay as
+// close to the sphere as an even tessellation of that size would; returns false if any level drifts further
+bool checkMeshSimplification();
+
+// Time the reference stream parser, the memory-mapped parser and the binary mesh cache on one OBJ file
+void benchmarkModelLoad(const std::string& objPath, int iterations);
+
+// Time the cached fixed-point undistortion against cv::undistort, and pose/projection calls with and without distortion terms
+void benchmarkUndistortion(const std::string& calibrationPath, int iterations);
+
+// Time the per-call ORB and Harris functions against the grid FeatureDetector on synthetic frames at several resolutions
+void benchmarkFeatureDetection(int iterations);
+
+// Time the bundle adjustment, in parallel and on one thread, against cv::calibrateCamera on synthetic views
+// from 10 up to maxViews; cv::calibrateCamera only runs up to compareLimit views because its solve grows cubically
+void benchmarkBundleAdjustment(int maxViews, int compareLimit);
+
+// Compare the chessboard detector backends on recorded frames (empty inputs use the sets in res): latency,
+// detection rate, and corner accuracy as the distance from a homography fit to the undistorted board grid and
+// from the classic detector's corners
+bool benchmarkBoardDetectors(const std::vector<std::string>& inputs, const std::string& calibrationPath, int passes);
+
+// Settings of a headless replay run
+struct ReplayOptions {
+    std::vector<std::string> inputs;    // Image directories, image files or video files; empty replays the sets in res
+    std::string calibrationPath;        // Empty tries res/calibration.calib, then res/calibration_data.csv
+    std::string modelPath;              // Empty skips the model stage
+    std::string jsonPath = "replay_results.json";
+    int passes = 3;                     // Timed passes over all frames, after one untimed warm-up pass
+    int maxVideoFrames = 300;           // Frames read from each video file
+};
+
+// Replay recorded frames through detection, pose, axes, model and feature stages without a display.
+// Writes per-stage latency percentiles, throughput and allocation counts to options.jsonPath.
+bool runReplayBenchmark(const ReplayOptions& options);
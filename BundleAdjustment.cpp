@@ -0,0 +1,334 @@
+#include "BundleAdjustment.h"
+#include "Timing.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Shared parameters: fx, fy, cx, cy, k1, k2, p1, p2, k3
+typedef cv::Vec<double, 9> Vec9;
+typedef cv::Vec<double, 6> Vec6;
+typedef cv::Matx<double, 9, 9> Mat99;
+typedef cv::Matx<double, 9, 6> Mat96;
+typedef cv::Matx<double, 6, 6> Mat66;
+
+// One view's blocks of the Gauss-Newton normal equations at the current parameters
+struct ViewSystem {
+    Mat66 V;       // Pose with pose
+    Mat96 W;       // Intrinsics with pose
+    Mat99 U;       // This view's share of the intrinsics block
+    Vec6 gv;       // Pose gradient
+    Vec9 gc;       // This view's share of the intrinsics gradient
+    double cost = 0.0;
+    Mat66 Vinv;    // Damped pose block, inverted
+    Mat96 Y;       // W * Vinv
+};
+
+struct Problem {
+    const std::vector<std::vector<cv::Point2f>>* corners;
+    const std::vector<cv::Vec3f>* objectPoints;
+    std::vector<int> views;   // Views taking part in the solve
+    double huberDelta;
+    bool fixAspectRatio;
+    double aspect;            // fx / fy while the aspect ratio is fixed
+    bool parallel;
+};
+
+void forEachView(size_t count, bool parallel, const std::function<void(size_t)>& body) {
+    if (!parallel) {
+        for (size_t i = 0; i < count; ++i) body(i);
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, int(count)), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) body(size_t(i));
+    });
+}
+
+cv::Matx33d cameraMatrixOf(const Vec9& c) {
+    return cv::Matx33d(c[0], 0.0, c[2], 0.0, c[1], c[3], 0.0, 0.0, 1.0);
+}
+
+cv::Vec<double, 5> distortionOf(const Vec9& c) {
+    return cv::Vec<double, 5>(c[4], c[5], c[6], c[7], c[8]);
+}
+
+// Huber loss of one corner's residual length, and the weight that turns it into a least-squares step
+double huberCost(double e, double delta) {
+    return delta <= 0.0 || e <= delta ? e * e : 2.0 * delta * e - delta * delta;
+}
+
+double huberWeight(double e, double delta) {
+    return delta <= 0.0 || e <= delta ? 1.0 : delta / e;
+}
+
+void linearizeView(const Problem& problem, int view, const Vec9& c, const cv::Vec3d& rvec, const cv::Vec3d& tvec, ViewSystem& s) {
+    std::vector<cv::Point2f> projected;
+    cv::Mat J;  // Columns: rotation (3), translation (3), focal lengths (2), principal point (2), distortion (5)
+    cv::projectPoints(*problem.objectPoints, rvec, tvec, cameraMatrixOf(c), distortionOf(c), projected, J);
+
+    s.V = Mat66();
+    s.W = Mat96();
+    s.U = Mat99();
+    s.gv = Vec6();
+    s.gc = Vec9();
+    s.cost = 0.0;
+    const std::vector<cv::Point2f>& observed = (*problem.corners)[view];
+    for (size_t i = 0; i < projected.size(); ++i) {
+        double rx = projected[i].x - observed[i].x, ry = projected[i].y - observed[i].y;
+        double e = std::sqrt(rx * rx + ry * ry);
+        double w = huberWeight(e, problem.huberDelta);
+        s.cost += huberCost(e, problem.huberDelta);
+        for (int axis = 0; axis < 2; ++axis) {
+            const double* row = J.ptr<double>(int(2 * i) + axis);
+            Vec6 jv(row[0], row[1], row[2], row[3], row[4], row[5]);
+            Vec9 jc(row[6], row[7], row[8], row[9], row[10], row[11], row[12], row[13], row[14]);
+            if (problem.fixAspectRatio) {
+                // fx follows fy, so fy carries both focal derivatives and fx stays frozen
+                jc[1] += problem.aspect * jc[0];
+                jc[0] = 0.0;
+            }
+            double r = axis == 0 ? rx : ry;
+            s.V += w * (jv * jv.t());
+            s.W += w * (jc * jv.t());
+            s.U += w * (jc * jc.t());
+            s.gv += (w * r) * jv;
+            s.gc += (w * r) * jc;
+        }
+    }
+}
+
+// Robust cost of one view, and optionally its plain sum of squared corner errors
+double viewCost(const Problem& problem, int view, const Vec9& c, const cv::Vec3d& rvec, const cv::Vec3d& tvec, double* squaredError = nullptr) {
+    std::vector<cv::Point2f> projected;
+    cv::projectPoints(*problem.objectPoints, rvec, tvec, cameraMatrixOf(c), distortionOf(c), projected);
+    const std::vector<cv::Point2f>& observed = (*problem.corners)[view];
+    double cost = 0.0, squared = 0.0;
+    for (size_t i = 0; i < projected.size(); ++i) {
+        double rx = projected[i].x - observed[i].x, ry = projected[i].y - observed[i].y;
+        squared += rx * rx + ry * ry;
+        cost += huberCost(std::sqrt(rx * rx + ry * ry), problem.huberDelta);
+    }
+    if (squaredError) *squaredError = squared;
+    return cost;
+}
+
+// Levenberg-Marquardt over the shared intrinsics and the poses of the problem's views; returns the steps taken
+int levenbergMarquardt(const Problem& problem, Vec9& c, std::vector<cv::Vec3d>& rvecs, std::vector<cv::Vec3d>& tvecs, int maxIterations) {
+    const size_t n = problem.views.size();
+    std::vector<ViewSystem> systems(n);
+    std::vector<cv::Vec3d> trialR(n), trialT(n);
+    std::vector<double> trialCost(n);
+    Mat99 U;
+    Vec9 gc;
+    double cost = 0.0, lambda = 1e-3;
+    bool relinearize = true;
+
+    int iteration = 0;
+    while (iteration < maxIterations) {
+        ++iteration;
+        if (relinearize) {
+            forEachView(n, problem.parallel, [&](size_t k) {
+                int v = problem.views[k];
+                linearizeView(problem, v, c, rvecs[v], tvecs[v], systems[k]);
+            });
+            U = Mat99();
+            gc = Vec9();
+            cost = 0.0;
+            for (const ViewSystem& s : systems) {
+                U += s.U;
+                gc += s.gc;
+                cost += s.cost;
+            }
+            relinearize = false;
+        }
+
+        // Eliminate each view's pose block; what remains is a 9x9 system in the intrinsics alone
+        forEachView(n, problem.parallel, [&](size_t k) {
+            ViewSystem& s = systems[k];
+            Mat66 V = s.V;
+            for (int d = 0; d < 6; ++d) V(d, d) += lambda * V(d, d) + 1e-12;
+            s.Vinv = V.inv(cv::DECOMP_CHOLESKY);
+            s.Y = s.W * s.Vinv;
+        });
+        Mat99 S = U;
+        for (int d = 0; d < 9; ++d) S(d, d) += lambda * U(d, d) + 1e-12;
+        Vec9 rhs = -gc;
+        for (const ViewSystem& s : systems) {
+            S -= s.Y * s.W.t();
+            rhs += s.Y * s.gv;
+        }
+        if (problem.fixAspectRatio) {
+            for (int d = 0; d < 9; ++d) S(0, d) = S(d, 0) = 0.0;
+            S(0, 0) = 1.0;
+            rhs[0] = 0.0;
+        }
+        Vec9 dc = S.solve(rhs, cv::DECOMP_LU);
+        Vec9 trial = c + dc;
+        if (problem.fixAspectRatio) {
+            trial[0] = problem.aspect * trial[1];
+        }
+
+        // Back-substitute the pose steps and evaluate the cost there
+        forEachView(n, problem.parallel, [&](size_t k) {
+            const ViewSystem& s = systems[k];
+            int v = problem.views[k];
+            Vec6 dv = s.Vinv * (-s.gv - s.W.t() * dc);
+            trialR[k] = rvecs[v] + cv::Vec3d(dv[0], dv[1], dv[2]);
+            trialT[k] = tvecs[v] + cv::Vec3d(dv[3], dv[4], dv[5]);
+            trialCost[k] = viewCost(problem, v, trial, trialR[k], trialT[k]);
+        });
+        double newCost = 0.0;
+        for (double value : trialCost) newCost += value;
+
+        if (std::isfinite(newCost) && newCost < cost) {
+            double decrease = (cost - newCost) / std::max(cost, 1e-300);
+            c = trial;
+            for (size_t k = 0; k < n; ++k) {
+                rvecs[problem.views[k]] = trialR[k];
+                tvecs[problem.views[k]] = trialT[k];
+            }
+            lambda = std::max(lambda * 0.1, 1e-12);
+            relinearize = true;
+            if (decrease < 1e-10) {
+                break;
+            }
+        }
+        else {
+            // Rejected step: lean further towards gradient descent and try again from the same point
+            lambda *= 10.0;
+            if (lambda > 1e12) {
+                break;
+            }
+        }
+    }
+    return iteration;
+}
+
+} // namespace
+
+bool bundleAdjustCalibration(const std::vector<std::vector<cv::Point2f>>& corner_list,
+    const std::vector<cv::Vec3f>& objectPoints,
+    const cv::Size& imageSize,
+    cv::Mat& cameraMatrix,
+    cv::Mat& distCoeffs,
+    BundleAdjustmentResult& result,
+    const BundleAdjustmentOptions& options) {
+    result = BundleAdjustmentResult();
+    const size_t viewCount = corner_list.size();
+    if (viewCount < 3) {
+        std::cerr << "Error: bundle adjustment needs at least 3 views, got " << viewCount << std::endl;
+        return false;
+    }
+    for (const std::vector<cv::Point2f>& corners : corner_list) {
+        if (corners.size() != objectPoints.size()) {
+            std::cerr << "Error: every view needs " << objectPoints.size() << " corners" << std::endl;
+            return false;
+        }
+    }
+
+    Clock::time_point t0 = Clock::now();
+    if (cameraMatrix.empty()) {
+        std::vector<std::vector<cv::Vec3f>> point_list(viewCount, objectPoints);
+        cameraMatrix = cv::initCameraMatrix2D(point_list, corner_list, imageSize);
+        distCoeffs = cv::Mat();
+    }
+    cv::Mat K, D = cv::Mat::zeros(8, 1, CV_64F);
+    cameraMatrix.convertTo(K, CV_64F);
+    if (!distCoeffs.empty()) {
+        cv::Mat given;
+        distCoeffs.reshape(1, int(distCoeffs.total())).convertTo(given, CV_64F);
+        given.rowRange(0, std::min(int(given.total()), 5)).copyTo(D.rowRange(0, std::min(int(given.total()), 5)));
+    }
+    Vec9 c(K.at<double>(0, 0), K.at<double>(1, 1), K.at<double>(0, 2), K.at<double>(1, 2),
+        D.at<double>(0), D.at<double>(1), D.at<double>(2), D.at<double>(3), D.at<double>(4));
+
+    // Starting poses from each view's corners alone
+    result.rvecs.resize(viewCount);
+    result.tvecs.resize(viewCount);
+    forEachView(viewCount, options.parallel, [&](size_t i) {
+        cv::solvePnP(objectPoints, corner_list[i], cameraMatrixOf(c), distortionOf(c), result.rvecs[i], result.tvecs[i]);
+    });
+    Clock::time_point t1 = Clock::now();
+    result.initMs = elapsedMs(t0, t1);
+
+    Problem problem;
+    problem.corners = &corner_list;
+    problem.objectPoints = &objectPoints;
+    problem.huberDelta = options.huberDelta;
+    problem.fixAspectRatio = options.fixAspectRatio;
+    problem.aspect = c[0] / c[1];
+    problem.parallel = options.parallel;
+    result.rejected.assign(viewCount, false);
+    for (size_t i = 0; i < viewCount; ++i) {
+        problem.views.push_back(int(i));
+    }
+
+    std::vector<double> squaredErrors(viewCount);
+    for (int round = 0; ; ++round) {
+        result.iterations += levenbergMarquardt(problem, c, result.rvecs, result.tvecs, options.maxIterations);
+
+        // Error of every view, including those already rejected, at the current intrinsics
+        result.perViewErrors.resize(viewCount);
+        forEachView(viewCount, options.parallel, [&](size_t i) {
+            viewCost(problem, int(i), c, result.rvecs[i], result.tvecs[i], &squaredErrors[i]);
+            result.perViewErrors[i] = std::sqrt(squaredErrors[i] / objectPoints.size());
+        });
+        if (round >= options.maxRejectionRounds) {
+            break;
+        }
+
+        // Reject views far above the median error, but never so many that fewer than half remain
+        std::vector<double> kept;
+        for (int v : problem.views) kept.push_back(result.perViewErrors[v]);
+        std::nth_element(kept.begin(), kept.begin() + kept.size() / 2, kept.end());
+        double threshold = std::max(options.minOutlierRms, options.outlierViewFactor * kept[kept.size() / 2]);
+        std::vector<int> remaining;
+        for (int v : problem.views) {
+            if (result.perViewErrors[v] <= threshold) remaining.push_back(v);
+        }
+        if (remaining.size() == problem.views.size() || remaining.size() < std::max<size_t>(3, viewCount / 2)) {
+            break;
+        }
+        for (int v : problem.views) {
+            if (result.perViewErrors[v] > threshold) result.rejected[v] = true;
+        }
+        problem.views.swap(remaining);
+    }
+
+    double squaredTotal = 0.0;
+    for (int v : problem.views) squaredTotal += squaredErrors[v];
+    result.rms = std::sqrt(squaredTotal / (problem.views.size() * objectPoints.size()));
+    result.rejectedViews = int(viewCount - problem.views.size());
+    result.solveMs = elapsedMs(t1, Clock::now());
+
+    cameraMatrix = cv::Mat(cameraMatrixOf(c));
+    distCoeffs = cv::Mat::zeros(8, 1, CV_64F);
+    for (int i = 0; i < 5; ++i) {
+        distCoeffs.at<double>(i) = c[4 + i];
+    }
+    return true;
+}
+
+void printBundleAdjustmentResult(const BundleAdjustmentResult& result) {
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Bundle adjustment: " << result.perViewErrors.size() << " views, re-projection error " << result.rms << " px, "
+        << result.iterations << " iterations, " << result.initMs << " ms start, " << result.solveMs << " ms solve" << std::endl;
+    if (result.rejectedViews > 0) {
+        std::cout << "  rejected " << result.rejectedViews << " views:";
+        int listed = 0;
+        for (size_t i = 0; i < result.rejected.size() && listed < 10; ++i) {
+            if (result.rejected[i]) {
+                std::cout << " " << i << " (" << result.perViewErrors[i] << " px)";
+                listed++;
+            }
+        }
+        std::cout << (result.rejectedViews > listed ? " ..." : "") << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+struct BundleAdjustmentOptions {
+    int maxIterations = 100;
+    double huberDelta = 1.0;          // Residuals beyond this many pixels count linearly; 0 uses plain least squares
+    double outlierViewFactor = 3.0;   // Views whose error exceeds this multiple of the median view error are rejected...
+    double minOutlierRms = 1.0;       // ...as long as it is also above this many pixels
+    int maxRejectionRounds = 3;       // Re-solves after rejecting views
+    bool fixAspectRatio = false;      // Keep fx / fy at its starting value
+    bool parallel = true;             // Spread the per-view work over OpenCV's thread pool
+};
+
+struct BundleAdjustmentResult {
+    double rms = -1.0;                   // Re-projection error over the views that were kept
+    std::vector<double> perViewErrors;   // Re-projection error of every view, rejected ones included
+    std::vector<bool> rejected;          // Views left out of the final solve
+    std::vector<cv::Vec3d> rvecs, tvecs;
+    int iterations = 0;
+    int rejectedViews = 0;
+    double initMs = 0.0;                 // Starting intrinsics and per-view poses
+    double solveMs = 0.0;
+};
+
+// Jointly refine the intrinsics, the distortion (k1, k2, p1, p2, k3) and every view's pose with Levenberg-Marquardt.
+// Each residual depends on the shared intrinsics and one view's pose only, so the view blocks of the normal
+// equations are eliminated with the Schur complement and each iteration costs time linear in the number of views.
+// Residuals and Jacobians are computed per view in parallel. A Huber loss limits the pull of single bad corners,
+// and views whose error stays far above the others are rejected and the solve repeated without them.
+// An empty cameraMatrix is initialised from the views; otherwise cameraMatrix and distCoeffs are the starting guess.
+bool bundleAdjustCalibration(const std::vector<std::vector<cv::Point2f>>& corner_list,
+    const std::vector<cv::Vec3f>& objectPoints,
+    const cv::Size& imageSize,
+    cv::Mat& cameraMatrix,
+    cv::Mat& distCoeffs,
+    BundleAdjustmentResult& result,
+    const BundleAdjustmentOptions& options = BundleAdjustmentOptions());
+
+void printBundleAdjustmentResult(const BundleAdjustmentResult& result);
@@ -0,0 +1,203 @@
+#include "CalibrationFile.h"
+#include "MappedFile.h"
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+// Binary layout: header, then distortion coefficients, per-view errors, and the map path bytes
+const char calibrationMagic[4] = { 'A', 'R', 'C', 'L' };
+const uint32_t calibrationVersion = 1;
+
+struct CalibrationHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t imageWidth;
+    uint32_t imageHeight;
+    uint32_t distCount;
+    uint32_t viewCount;
+    uint32_t mapPathLength;
+    uint32_t reserved;
+    double rms;
+    double cameraMatrix[9];
+};
+
+bool isNumberStart(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+}
+
+// Parse the next number at or after p, stopping at stop; advances p past it
+bool nextNumber(const char*& p, const char* end, char stop, double& value) {
+    while (p < end && *p != stop && !isNumberStart(*p)) ++p;
+    if (p >= end || *p == stop) return false;
+    if (*p == '+') ++p;
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) return false;
+    p = result.ptr;
+    return true;
+}
+
+const char* findText(const char* begin, const char* end, const char* text) {
+    size_t length = std::strlen(text);
+    for (const char* p = begin; p + length <= end; ++p) {
+        if (std::memcmp(p, text, length) == 0) return p + length;
+    }
+    return nullptr;
+}
+
+// Text files written by saveCalibrationData, with either one value per line or a single bracketed row
+bool parseLegacyCalibration(const char* data, size_t size, CalibrationData& calibration) {
+    if (size == 0) {
+        return false;
+    }
+    const char* end = data + size;
+    const char* matrix = findText(data, end, "Camera Matrix:");
+    if (!matrix) {
+        return false;
+    }
+    calibration.cameraMatrix = cv::Mat::eye(3, 3, CV_64F);
+    for (int i = 0; i < 9; ++i) {
+        if (!nextNumber(matrix, end, '\0', calibration.cameraMatrix.at<double>(i / 3, i % 3))) return false;
+    }
+
+    // Older writers labelled the coefficients with any of these headers
+    const char* distortionHeaders[] = { "Distortion Coefficients:", "distortion Coefficients:", "distCoefficients:" };
+    const char* distortion = nullptr;
+    for (const char* header : distortionHeaders) {
+        if (!distortion) distortion = findText(data, end, header);
+    }
+    double coefficients[14];
+    int count = 0;
+    if (distortion) {
+        // Coefficients run until the closing bracket of the OpenCV matrix printout
+        while (count < 14 && nextNumber(distortion, end, ']', coefficients[count])) count++;
+    }
+    calibration.distCoeffs = cv::Mat(count, 1, CV_64F);
+    for (int i = 0; i < count; ++i) {
+        calibration.distCoeffs.at<double>(i) = coefficients[i];
+    }
+
+    const char* error = findText(data, end, "Re-Projection Error");
+    calibration.rms = -1.0;
+    if (error) {
+        while (error < end && *error != ':') ++error;
+        nextNumber(error, end, '\n', calibration.rms);
+    }
+    calibration.version = 0;
+    return true;
+}
+
+bool parseBinaryCalibration(const char* data, size_t size, CalibrationData& calibration) {
+    CalibrationHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.version != calibrationVersion) {
+        std::cerr << "Unsupported calibration file version " << header.version << std::endl;
+        return false;
+    }
+    size_t expected = sizeof(header) + (size_t(header.distCount) + header.viewCount) * sizeof(double) + header.mapPathLength;
+    if (expected != size) {
+        return false;
+    }
+
+    calibration.version = header.version;
+    calibration.imageSize = cv::Size(int(header.imageWidth), int(header.imageHeight));
+    calibration.rms = header.rms;
+    calibration.cameraMatrix = cv::Mat(3, 3, CV_64F);
+    std::memcpy(calibration.cameraMatrix.ptr<double>(), header.cameraMatrix, sizeof(header.cameraMatrix));
+    const char* p = data + sizeof(header);
+    calibration.distCoeffs = cv::Mat(int(header.distCount), 1, CV_64F);
+    if (header.distCount > 0) {
+        std::memcpy(calibration.distCoeffs.ptr<double>(), p, header.distCount * sizeof(double));
+    }
+    p += header.distCount * sizeof(double);
+    calibration.perViewErrors.resize(header.viewCount);
+    if (header.viewCount > 0) {
+        std::memcpy(calibration.perViewErrors.data(), p, header.viewCount * sizeof(double));
+    }
+    p += header.viewCount * sizeof(double);
+    calibration.undistortMapPath.assign(p, header.mapPathLength);
+    return true;
+}
+
+} // namespace
+
+bool saveCalibration(const std::string& path, const CalibrationData& data) {
+    cv::Mat K, D;
+    data.cameraMatrix.convertTo(K, CV_64F);
+    data.distCoeffs.convertTo(D, CV_64F);
+    if (K.rows != 3 || K.cols != 3) {
+        return false;
+    }
+
+    CalibrationHeader header{};
+    std::memcpy(header.magic, calibrationMagic, sizeof(header.magic));
+    header.version = calibrationVersion;
+    header.imageWidth = uint32_t(data.imageSize.width);
+    header.imageHeight = uint32_t(data.imageSize.height);
+    header.distCount = uint32_t(D.total());
+    header.viewCount = uint32_t(data.perViewErrors.size());
+    header.mapPathLength = uint32_t(data.undistortMapPath.size());
+    header.rms = data.rms;
+    for (int i = 0; i < 9; ++i) {
+        header.cameraMatrix[i] = K.at<double>(i / 3, i % 3);
+    }
+
+    // Write next to the final path and rename so a failed save never leaves a truncated calibration
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (size_t i = 0; i < D.total(); ++i) {
+            double value = D.at<double>(int(i));
+            out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+        if (!data.perViewErrors.empty()) {
+            out.write(reinterpret_cast<const char*>(data.perViewErrors.data()), data.perViewErrors.size() * sizeof(double));
+        }
+        out.write(data.undistortMapPath.data(), data.undistortMapPath.size());
+        if (!out.good()) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        return false;
+    }
+
+    // Human-readable mirror for inspection; the binary file stays authoritative
+    cv::FileStorage mirror(path + ".yml", cv::FileStorage::WRITE);
+    if (mirror.isOpened()) {
+        mirror << "version" << int(calibrationVersion);
+        mirror << "image_width" << data.imageSize.width;
+        mirror << "image_height" << data.imageSize.height;
+        mirror << "camera_matrix" << K;
+        mirror << "distortion_coefficients" << D;
+        mirror << "rms" << data.rms;
+        mirror << "per_view_errors" << data.perViewErrors;
+        mirror << "undistort_map" << data.undistortMapPath;
+    }
+    return true;
+}
+
+bool loadCalibration(const std::string& path, CalibrationData& data) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Error: Could not open file " << path << std::endl;
+        return false;
+    }
+    data = CalibrationData();
+    bool loaded = file.size() >= sizeof(CalibrationHeader) && std::memcmp(file.data(), calibrationMagic, sizeof(calibrationMagic)) == 0
+        ? parseBinaryCalibration(file.data(), file.size(), data)
+        : parseLegacyCalibration(file.data(), file.size(), data);
+    if (!loaded) {
+        std::cerr << "Error: Could not parse calibration file " << path << std::endl;
+    }
+    return loaded;
+}
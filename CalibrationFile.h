@@ -0,0 +1,23 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Everything one camera needs at startup
+struct CalibrationData {
+    uint32_t version = 1;
+    cv::Size imageSize;
+    cv::Mat cameraMatrix;              // 3x3, CV_64F
+    cv::Mat distCoeffs;                // Nx1, CV_64F
+    double rms = -1.0;                 // Overall re-projection error
+    std::vector<double> perViewErrors; // Re-projection error of each calibration view
+    std::string undistortMapPath;      // Precomputed undistortion map for this calibration, empty if none
+};
+
+// Write the compact binary file and a human-readable YAML mirror next to it (<path>.yml)
+bool saveCalibration(const std::string& path, const CalibrationData& data);
+
+// Read a binary calibration file, or the older "Camera Matrix: / Distortion Coefficients:" text files.
+// Neither path uses regular expressions or allocates per line.
+bool loadCalibration(const std::string& path, CalibrationData& data);
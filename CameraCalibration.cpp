@@ -1,12 +1,29 @@
 #include "CameraCalibration.h"
-#include "CameraCalibration.h"
 #include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+
+std::vector<cv::Vec3f> boardObjectPoints(const cv::Size& patternSize) {
+    std::vector<cv::Vec3f> points;
+    points.reserve(patternSize.area());
+    for (int i = 0; i < patternSize.height; ++i) {
+        for (int j = 0; j < patternSize.width; ++j) {
+            points.push_back(cv::Vec3f(float(j), float(-i), 0.0f));
+        }
+    }
+    return points;
+}
 
-void calibrateCamera(const std::vector<std::vector<cv::Point2f>>& corner_list,
+double calibrateCamera(const std::vector<std::vector<cv::Point2f>>& corner_list,
     const std::vector<std::vector<cv::Vec3f>>& point_list,
     const cv::Size& imageSize,
     cv::Mat& cameraMatrix,
-    cv::Mat& distCoeffs) {
+    cv::Mat& distCoeffs,
+    int flags,
+    std::vector<double>* perViewErrors) {
+    double rms = -1.0;
     if (corner_list.size() >= 5) {
         cameraMatrix = cv::Mat::eye(3, 3, CV_64F);
         cameraMatrix.at<double>(0, 2) = imageSize.width / 2;
@@ -14,12 +31,18 @@ void calibrateCamera(const std::vector<std::vector<cv::Point2f>>& corner_list,
 
         distCoeffs = cv::Mat::zeros(8, 1, CV_64F);
         std::vector<cv::Mat> rvecs, tvecs;
-        double rms = cv::calibrateCamera(point_list, corner_list, imageSize, cameraMatrix, distCoeffs, rvecs, tvecs);
+        cv::Mat stdDevIntrinsics, stdDevExtrinsics, viewErrors;
+        rms = cv::calibrateCamera(point_list, corner_list, imageSize, cameraMatrix, distCoeffs, rvecs, tvecs,
+            stdDevIntrinsics, stdDevExtrinsics, viewErrors, flags);
+        if (perViewErrors) {
+            perViewErrors->assign(viewErrors.ptr<double>(), viewErrors.ptr<double>() + viewErrors.total());
+        }
 
         std::cout << "Camera matrix: " << cameraMatrix << std::endl;
         std::cout << "Distortion coefficients: " << distCoeffs << std::endl;
         std::cout << "Re-projection error: " << rms << std::endl;
     }
+    return rms;
 }
 
 bool saveCalibrationData(const std::string& filename, const cv::Mat& cameraMatrix, const cv::Mat& distCoefficients, double reProjectionError) {
@@ -36,4 +59,196 @@ bool saveCalibrationData(const std::string& filename, const cv::Mat& cameraMatri
     return true;
 }
 
+namespace {
+
+// Warm start from the previous solution with a short iteration budget; the first solve is cold
+void runCalibration(const std::vector<std::vector<cv::Point2f>>& corner_list, const std::vector<cv::Vec3f>& objectPoints,
+    const cv::Size& imageSize, int flags, int warmIterations, cv::Mat& K, cv::Mat& D, double& rms,
+    std::vector<double>& viewErrors, std::vector<cv::Vec3d>& rvecs, std::vector<cv::Vec3d>& tvecs) {
+    std::vector<std::vector<cv::Vec3f>> point_list(corner_list.size(), objectPoints);
+    int solveFlags = flags;
+    cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, DBL_EPSILON);
+    if (!K.empty()) {
+        solveFlags |= cv::CALIB_USE_INTRINSIC_GUESS;
+        criteria.maxCount = warmIterations;
+    }
+    else {
+        K = cv::Mat::eye(3, 3, CV_64F);
+        D = cv::Mat::zeros(8, 1, CV_64F);
+    }
+
+    std::vector<cv::Mat> rvecMats, tvecMats;
+    cv::Mat stdDevIntrinsics, stdDevExtrinsics, errors;
+    rms = cv::calibrateCamera(point_list, corner_list, imageSize, K, D, rvecMats, tvecMats, stdDevIntrinsics, stdDevExtrinsics, errors, solveFlags, criteria);
+    viewErrors.assign(errors.ptr<double>(), errors.ptr<double>() + errors.total());
+    rvecs.clear();
+    tvecs.clear();
+    for (size_t i = 0; i < rvecMats.size(); ++i) {
+        rvecs.push_back(cv::Vec3d(rvecMats[i].at<double>(0), rvecMats[i].at<double>(1), rvecMats[i].at<double>(2)));
+        tvecs.push_back(cv::Vec3d(tvecMats[i].at<double>(0), tvecMats[i].at<double>(1), tvecMats[i].at<double>(2)));
+    }
+}
+
+} // namespace
+
+IncrementalCalibrator::IncrementalCalibrator(const cv::Size& patternSize, int maxViews)
+    : patternSize(patternSize), maxViews(size_t(std::max(maxViews, 1))), objectPoints(boardObjectPoints(patternSize)) {
+    coverage.assign(size_t(gridSize.area()), 0);
+}
+
+std::vector<int> IncrementalCalibrator::coveredCells(const std::vector<cv::Point2f>& corners) const {
+    // Rasterize the board outline onto a coarse grid over the image
+    std::vector<cv::Point> outline;
+    for (cv::Point2f corner : { corners.front(), corners[patternSize.width - 1], corners.back(), corners[patternSize.width * (patternSize.height - 1)] }) {
+        outline.push_back(cv::Point(int(corner.x * gridSize.width / imageSize.width), int(corner.y * gridSize.height / imageSize.height)));
+    }
+    cv::Mat mask = cv::Mat::zeros(gridSize, CV_8U);
+    cv::fillConvexPoly(mask, outline, cv::Scalar(1));
+
+    std::vector<int> cells;
+    for (int y = 0; y < mask.rows; ++y) {
+        for (int x = 0; x < mask.cols; ++x) {
+            if (mask.at<uchar>(y, x)) cells.push_back(y * gridSize.width + x);
+        }
+    }
+    return cells;
+}
+
+double IncrementalCalibrator::poseDistance(const KeptView& a, const KeptView& b) {
+    // Relative rotation angle, and the angle between the directions to the board
+    cv::Matx33d Ra, Rb, Rrel;
+    cv::Rodrigues(a.rvec, Ra);
+    cv::Rodrigues(b.rvec, Rb);
+    Rrel = Ra.t() * Rb;
+    cv::Vec3d axisAngle;
+    cv::Rodrigues(Rrel, axisAngle);
+    double rotation = cv::norm(axisAngle);
+    double cosine = a.tvec.dot(b.tvec) / std::max(cv::norm(a.tvec) * cv::norm(b.tvec), 1e-12);
+    double direction = std::acos(std::max(-1.0, std::min(1.0, cosine)));
+    return std::max(rotation, direction) * 180.0 / CV_PI;
+}
+
+ViewScore IncrementalCalibrator::addView(const std::vector<cv::Point2f>& corners, const cv::Size& viewImageSize, const cv::Mat& currentCameraMatrix, const cv::Mat& currentDistCoeffs) {
+    ViewScore score;
+    if (corners.size() != objectPoints.size()) {
+        return score;
+    }
+    if (imageSize != viewImageSize) {
+        // A new resolution starts a new session
+        imageSize = viewImageSize;
+        views.clear();
+        coverage.assign(size_t(gridSize.area()), 0);
+        solution = false;
+        solveWanted = false;
+        session++;  // A solve still running for the old size is discarded when it finishes
+    }
+
+    KeptView candidate;
+    candidate.corners = corners;
+    candidate.cells = coveredCells(corners);
+    candidate.id = nextViewId++;
+    const cv::Mat& K = solution ? solvedCameraMatrix : currentCameraMatrix;
+    const cv::Mat& D = solution ? solvedDistCoeffs : currentDistCoeffs;
+    cv::solvePnP(objectPoints, corners, K, D, candidate.rvec, candidate.tvec);
+
+    int newCells = 0;
+    for (int cell : candidate.cells) {
+        if (coverage[cell] == 0) newCells++;
+    }
+    score.coverageGain = double(newCells) / gridSize.area();
+    score.poseDistanceDeg = 180.0;
+    for (const KeptView& view : views) {
+        score.poseDistanceDeg = std::min(score.poseDistanceDeg, poseDistance(view, candidate));
+    }
+    if (score.coverageGain < minCoverageGain && score.poseDistanceDeg < minPoseDistanceDeg) {
+        return score;  // Duplicates an existing view
+    }
+
+    if (views.size() >= maxViews) {
+        // Swap out the kept view closest to the others, if the candidate is more distinct than it
+        size_t redundant = 0;
+        double redundantDistance = 1e300;
+        for (size_t i = 0; i < views.size(); ++i) {
+            double nearest = 1e300;
+            for (size_t j = 0; j < views.size(); ++j) {
+                if (i != j) nearest = std::min(nearest, poseDistance(views[i], views[j]));
+            }
+            if (nearest < redundantDistance) {
+                redundantDistance = nearest;
+                redundant = i;
+            }
+        }
+        if (score.poseDistanceDeg <= redundantDistance && score.coverageGain < minCoverageGain) {
+            return score;
+        }
+        for (int cell : views[redundant].cells) coverage[cell]--;
+        views.erase(views.begin() + redundant);
+        score.replacedView = true;
+    }
+
+    for (int cell : candidate.cells) coverage[cell]++;
+    views.push_back(std::move(candidate));
+    score.accepted = true;
+
+    if (views.size() >= size_t(minViews)) {
+        solveWanted = true;
+        score.solveQueued = true;
+        if (!pendingSolve.valid()) {
+            startSolve();
+        }
+    }
+    return score;
+}
+
+void IncrementalCalibrator::startSolve() {
+    // The worker gets copies of the views and the starting guess, so the kept views can keep changing meanwhile
+    std::vector<std::vector<cv::Point2f>> corner_list;
+    SolveResult job;
+    job.session = session;
+    for (const KeptView& view : views) {
+        corner_list.push_back(view.corners);
+        job.viewIds.push_back(view.id);
+    }
+    if (solution) {
+        job.cameraMatrix = solvedCameraMatrix.clone();
+        job.distCoeffs = solvedDistCoeffs.clone();
+    }
+    solveWanted = false;
+    pendingSolve = std::async(std::launch::async, [corner_list = std::move(corner_list), job = std::move(job),
+        points = objectPoints, size = imageSize, solveFlags = flags, iterations = warmIterations]() mutable {
+        auto start = std::chrono::steady_clock::now();
+        runCalibration(corner_list, points, size, solveFlags, iterations, job.cameraMatrix, job.distCoeffs, job.rms, job.viewErrors, job.rvecs, job.tvecs);
+        job.solveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return job;
+    });
+}
 
+bool IncrementalCalibrator::update() {
+    if (!pendingSolve.valid() || pendingSolve.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return false;
+    }
+    SolveResult result = pendingSolve.get();
+    bool published = result.session == session;
+    if (published) {
+        solvedCameraMatrix = result.cameraMatrix;
+        solvedDistCoeffs = result.distCoeffs;
+        rms = result.rms;
+        viewErrors = result.viewErrors;
+        solveMs = result.solveMs;
+        solution = true;
+
+        // Later pose-diversity checks use the refined poses of the views that are still kept
+        for (size_t i = 0; i < result.viewIds.size(); ++i) {
+            for (KeptView& view : views) {
+                if (view.id == result.viewIds[i]) {
+                    view.rvec = result.rvecs[i];
+                    view.tvec = result.tvecs[i];
+                }
+            }
+        }
+    }
+    if (solveWanted && views.size() >= size_t(minViews)) {
+        startSolve();
+    }
+    return published;
+}
@@ -1,12 +1,97 @@
 #pragma once
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <future>
+#include <cstdint>
 
-void calibrateCamera(const std::vector<std::vector<cv::Point2f>>& corner_list,
+// 3D corner positions of the chessboard in board units (one unit per square, y pointing up)
+std::vector<cv::Vec3f> boardObjectPoints(const cv::Size& patternSize);
+
+// Calibrate from at least 5 views; returns the re-projection error, or -1 if there are too few views
+double calibrateCamera(const std::vector<std::vector<cv::Point2f>>& corner_list,
     const std::vector<std::vector<cv::Vec3f>>& point_list,
     const cv::Size& imageSize,
     cv::Mat& cameraMatrix,
-    cv::Mat& distCoeffs);
+    cv::Mat& distCoeffs,
+    int flags = 0,
+    std::vector<double>* perViewErrors = nullptr);
 
 bool saveCalibrationData(const std::string& filename, const cv::Mat& cameraMatrix, const cv::Mat& distCoefficients, double reProjectionError);
 
+// Outcome of offering one view to the incremental calibrator
+struct ViewScore {
+    double coverageGain = 0.0;      // Fraction of the image grid this view covers for the first time
+    double poseDistanceDeg = 0.0;   // Smallest rotation/direction difference to the kept views
+    bool accepted = false;
+    bool replacedView = false;      // At the cap, the most redundant view was swapped out
+    bool solveQueued = false;       // A new solution will be computed in the background
+};
+
+// Calibrator that keeps only informative views up to a cap and re-solves warm-started from the last solution.
+// Solves run on a worker thread so the caller never waits on cv::calibrateCamera; a view added while a solve
+// is running queues one more solve over the latest views.
+class IncrementalCalibrator {
+public:
+    IncrementalCalibrator(const cv::Size& patternSize, int maxViews = 20);
+
+    // Score the view against the kept ones using the current intrinsics, keep it if it adds information,
+    // and queue a re-solve once there are enough views
+    ViewScore addView(const std::vector<cv::Point2f>& corners, const cv::Size& imageSize, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs);
+
+    // Publish a finished solve and start the queued one, if any; returns true when a new solution was published
+    bool update();
+    bool isSolving() const { return pendingSolve.valid(); }
+
+    bool hasSolution() const { return solution; }
+    const cv::Mat& cameraMatrix() const { return solvedCameraMatrix; }
+    const cv::Mat& distCoeffs() const { return solvedDistCoeffs; }
+    double reprojectionError() const { return rms; }
+    const std::vector<double>& perViewErrors() const { return viewErrors; }
+    double lastSolveMs() const { return solveMs; }
+    size_t viewCount() const { return views.size(); }
+
+    int minViews = 5;
+    double minCoverageGain = 0.02;
+    double minPoseDistanceDeg = 8.0;
+    int flags = cv::CALIB_FIX_ASPECT_RATIO;
+    int warmIterations = 10;  // Iteration limit once a previous solution seeds the solver
+
+private:
+    struct KeptView {
+        std::vector<cv::Point2f> corners;
+        cv::Vec3d rvec, tvec;
+        std::vector<int> cells;  // Coverage grid cells under the board
+        uint64_t id = 0;
+    };
+
+    // Everything a background solve produces, tagged with the views and session it was computed for
+    struct SolveResult {
+        int session = 0;
+        std::vector<uint64_t> viewIds;
+        cv::Mat cameraMatrix, distCoeffs;
+        double rms = -1.0;
+        std::vector<double> viewErrors;
+        std::vector<cv::Vec3d> rvecs, tvecs;
+        double solveMs = 0.0;
+    };
+
+    std::vector<int> coveredCells(const std::vector<cv::Point2f>& corners) const;
+    static double poseDistance(const KeptView& a, const KeptView& b);
+    void startSolve();
+
+    cv::Size patternSize, imageSize;
+    size_t maxViews;
+    cv::Size gridSize = cv::Size(16, 12);
+    std::vector<int> coverage;  // Number of kept views covering each grid cell
+    std::vector<KeptView> views;
+    std::vector<cv::Vec3f> objectPoints;
+    cv::Mat solvedCameraMatrix, solvedDistCoeffs;
+    bool solution = false;
+    double rms = -1.0;
+    std::vector<double> viewErrors;
+    double solveMs = 0.0;
+    uint64_t nextViewId = 0;
+    int session = 0;                // Bumped when a new image size discards the kept views
+    bool solveWanted = false;       // The views changed since the running solve started
+    std::future<SolveResult> pendingSolve;
+};
@@ -1,16 +1,270 @@
 #include "ChessboardDetection.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 
-bool findChessboardCorners(const cv::Mat& frame, const cv::Size& patternSize, std::vector<cv::Point2f>& corner_set) {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void refineChessboardCorners(const cv::Mat& gray, std::vector<cv::Point2f>& corner_set, const DetectionSettings& settings) {
+    PROFILE_SCOPE("cornerSubPix");
+    cv::cornerSubPix(gray, corner_set, cv::Size(settings.subPixWindow, settings.subPixWindow), cv::Size(-1, -1),
+        cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::MAX_ITER, settings.subPixIterations, 0.1));
+}
+
+const BoardDetectorBackend allBackends[] = {
+    BoardDetectorBackend::Classic, BoardDetectorBackend::ClassicFast, BoardDetectorBackend::Sector, BoardDetectorBackend::Precheck
+};
+
+} // namespace
+
+const char* boardDetectorName(BoardDetectorBackend backend) {
+    switch (backend) {
+    case BoardDetectorBackend::ClassicFast: return "fast";
+    case BoardDetectorBackend::Sector: return "sb";
+    case BoardDetectorBackend::Precheck: return "precheck";
+    default: return "classic";
+    }
+}
+
+bool parseBoardDetectorBackend(const std::string& name, BoardDetectorBackend& backend) {
+    for (BoardDetectorBackend candidate : allBackends) {
+        if (name == boardDetectorName(candidate)) {
+            backend = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+BoardDetector::BoardDetector(const cv::Size& patternSize, BoardDetectorBackend backend) : patternSize(patternSize), backend(backend) {}
+
+bool BoardDetector::search(const cv::Mat& image, std::vector<cv::Point2f>& corner_set, cv::Mat& scaled) {
+    // Search a downscaled copy when the settings ask for one; corners come back in full-size coordinates
+    const cv::Mat* searchImage = &image;
+    if (settings.scale < 1.0f) {
+        cv::resize(image, scaled, cv::Size(), settings.scale, settings.scale, cv::INTER_AREA);
+        searchImage = &scaled;
+    }
+
+    bool found;
+    {
+        PROFILE_SCOPE("findChessboardCorners");
+        switch (backend) {
+        case BoardDetectorBackend::Sector:
+            found = cv::findChessboardCornersSB(*searchImage, patternSize, corner_set, cv::CALIB_CB_NORMALIZE_IMAGE);
+            break;
+        case BoardDetectorBackend::ClassicFast:
+            found = cv::findChessboardCorners(*searchImage, patternSize, corner_set,
+                cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE | cv::CALIB_CB_FAST_CHECK);
+            break;
+        default:
+            found = cv::findChessboardCorners(*searchImage, patternSize, corner_set);
+            break;
+        }
+    }
+    if (!found || corner_set.empty()) {
+        return false;
+    }
+    if (settings.scale < 1.0f) {
+        for (cv::Point2f& corner : corner_set) {
+            corner /= settings.scale;
+        }
+    }
+    return true;
+}
+
+bool BoardDetector::detect(const cv::Mat& gray, std::vector<cv::Point2f>& corner_set, FrameArena* arena) {
+    Clock::time_point start = Clock::now();
+    detectorStats.calls++;
+    bool found = true;
+
+    // The pre-classifier only judges whether a board is likely there, which a small copy is enough for
+    if (backend == BoardDetectorBackend::Precheck) {
+        PROFILE_SCOPE("checkChessboard");
+        double f = std::min(1.0, double(precheckWidth) / std::max(gray.cols, 1));
+        const cv::Mat* checkImage = &gray;
+        cv::Mat arenaSmall = arena && f < 1.0 ? arena->mat(cvRound(gray.rows * f), cvRound(gray.cols * f), CV_8UC1) : cv::Mat();
+        cv::Mat& small = arena ? arenaSmall : precheckGray;
+        if (f < 1.0) {
+            cv::resize(gray, small, cv::Size(), f, f, cv::INTER_AREA);
+            checkImage = &small;
+        }
+        found = cv::checkChessboard(*checkImage, patternSize);
+        if (!found) {
+            detectorStats.prechecksRejected++;
+        }
+    }
+
+    if (found) {
+        cv::Mat arenaScaled = arena && settings.scale < 1.0f
+            ? arena->mat(cvRound(gray.rows * settings.scale), cvRound(gray.cols * settings.scale), CV_8UC1) : cv::Mat();
+        found = search(gray, corner_set, arena ? arenaScaled : scaledGray);
+        // The sector detector's corners are already sub-pixel accurate unless it searched a downscaled copy
+        if (found && (backend != BoardDetectorBackend::Sector || settings.scale < 1.0f)) {
+            refineChessboardCorners(gray, corner_set, settings);
+        }
+    }
+
+    detectorStats.found += found ? 1 : 0;
+    detectorStats.totalMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return found;
+}
+
+void drawBoardCorners(cv::Mat& frame, const cv::Size& patternSize, const std::vector<cv::Point2f>& corner_set) {
+    cv::drawChessboardCorners(frame, patternSize, cv::Mat(corner_set), true);
+}
+
+bool findChessboardCorners(const cv::Mat& frame, const cv::Size& patternSize, std::vector<cv::Point2f>& corner_set, FrameArena* arena,
+    const DetectionSettings& settings, BoardDetectorBackend backend) {
     // Convert to grayscale
-    cv::Mat grayFrame;
+    cv::Mat grayFrame = arena ? arena->mat(frame.size(), CV_8UC1) : cv::Mat();
     cv::cvtColor(frame, grayFrame, cv::COLOR_BGR2GRAY);
 
-    bool found = cv::findChessboardCorners(grayFrame, patternSize, corner_set);
-    if (found && !corner_set.empty()) {
-        // Refine corner locations
-        cv::cornerSubPix(grayFrame, corner_set, cv::Size(11, 11), cv::Size(-1, -1),
-            cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::MAX_ITER, 30, 0.1));
-        cv::drawChessboardCorners(frame, patternSize, cv::Mat(corner_set), found);
+    BoardDetector detector(patternSize, backend);
+    detector.settings = settings;
+    return detector.detect(grayFrame, corner_set, arena);
+}
+
+double TrackerStats::hitRate() const {
+    int64_t withBoard = flowHits + roiHits + fullHits;
+    return withBoard > 0 ? double(flowHits + roiHits) / withBoard : 0.0;
+}
+
+double TrackerStats::fallbackRate() const {
+    return frames > 0 ? double(fullSearches) / frames : 0.0;
+}
+
+ChessboardTracker::ChessboardTracker(const cv::Size& patternSize) : patternSize(patternSize), detector(patternSize) {
+    for (int i = 0; i < patternSize.height; ++i) {
+        for (int j = 0; j < patternSize.width; ++j) {
+            gridPoints.push_back(cv::Point2f(float(j), float(i)));
+        }
+    }
+}
+
+void ChessboardTracker::reset() {
+    hasPrevious = false;
+    prevCorners.clear();
+}
+
+bool ChessboardTracker::track(const cv::Mat& frame, std::vector<cv::Point2f>& corner_set, const std::vector<cv::Point2f>* predicted) {
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    counters.frames++;
+    if (predicted && predicted->size() != gridPoints.size()) {
+        predicted = nullptr;
+    }
+
+    bool found = false;
+    // Follow the previous corners with pyramidal optical flow
+    if (hasPrevious && trackWithFlow(corner_set, predicted)) {
+        counters.flowHits++;
+        found = true;
+    }
+    // Otherwise re-run the detector only around where the board should be, or where it was
+    else if (predicted || hasPrevious) {
+        if (detectInRegion(searchRegion(predicted ? *predicted : prevCorners), corner_set)) {
+            counters.roiHits++;
+            found = true;
+        }
+    }
+
+    // Fall back to searching the whole frame when tracking lost the board
+    if (!found) {
+        counters.fullSearches++;
+        found = detectInRegion(cv::Rect(0, 0, gray.cols, gray.rows), corner_set);
+        if (found) {
+            counters.fullHits++;
+        }
+    }
+
+    if (found) {
+        prevCorners.assign(corner_set.begin(), corner_set.end());
+        cv::swap(gray, prevGray);
+        hasPrevious = true;
+    }
+    else {
+        counters.lost++;
+        reset();
     }
     return found;
 }
+
+cv::Rect ChessboardTracker::searchRegion(const std::vector<cv::Point2f>& corners) const {
+    cv::Rect board = cv::boundingRect(corners);
+    int pad = int(roiPadding * std::max(board.width, board.height));
+    cv::Rect region(board.x - pad, board.y - pad, board.width + 2 * pad, board.height + 2 * pad);
+    return region & cv::Rect(0, 0, gray.cols, gray.rows);
+}
+
+bool ChessboardTracker::trackWithFlow(std::vector<cv::Point2f>& corner_set, const std::vector<cv::Point2f>* predicted) {
+    // Predicted corners start the search where the board is expected, so fast motion needs fewer pyramid levels
+    int flags = 0;
+    if (predicted) {
+        flowCorners.assign(predicted->begin(), predicted->end());
+        flags = cv::OPTFLOW_USE_INITIAL_FLOW;
+    }
+    PROFILE_SCOPE("opticalFlow");
+    cv::calcOpticalFlowPyrLK(prevGray, gray, prevCorners, flowCorners, flowStatus, flowError, cv::Size(15, 15), 2,
+        cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01), flags);
+
+    // Every corner has to be tracked with a small error
+    double totalError = 0.0;
+    for (size_t i = 0; i < flowCorners.size(); ++i) {
+        if (!flowStatus[i]) {
+            return false;
+        }
+        totalError += flowError[i];
+    }
+    if (flowCorners.empty() || totalError / flowCorners.size() > maxFlowError) {
+        return false;
+    }
+
+    // The tracked corners still have to form a planar grid, otherwise some of them slid onto the wrong corner
+    cv::Mat H = cv::findHomography(gridPoints, flowCorners);
+    if (H.empty()) {
+        return false;
+    }
+    std::vector<cv::Point2f> expected;
+    cv::perspectiveTransform(gridPoints, expected, H);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (cv::norm(expected[i] - flowCorners[i]) > maxGridResidual) {
+            return false;
+        }
+    }
+
+    corner_set.assign(flowCorners.begin(), flowCorners.end());
+    refineCorners(corner_set);
+    return true;
+}
+
+bool ChessboardTracker::detectInRegion(const cv::Rect& region, std::vector<cv::Point2f>& corner_set) {
+    if (region.empty()) {
+        return false;
+    }
+    detector.settings = settings;
+    detector.setBackend(backend);
+    if (!detector.detect(gray(region), corner_set)) {
+        return false;
+    }
+
+    // Corners were found and refined in region coordinates
+    for (cv::Point2f& corner : corner_set) {
+        corner.x += region.x;
+        corner.y += region.y;
+    }
+    return true;
+}
+
+void ChessboardTracker::refineCorners(std::vector<cv::Point2f>& corner_set) {
+    refineChessboardCorners(gray, corner_set, settings);
+}
+
+void printTrackerStats(const TrackerStats& stats) {
+    std::cout << "Chessboard tracking: " << stats.frames << " frames, " << stats.flowHits << " optical flow, "
+        << stats.roiHits << " region, " << stats.fullSearches << " full-frame searches (" << stats.fullHits << " found), "
+        << stats.lost << " lost" << std::endl;
+    std::cout << "  hit rate " << stats.hitRate() * 100.0 << "%, fallback rate " << stats.fallbackRate() * 100.0 << "%" << std::endl;
+}
@@ -1,6 +1,119 @@
 #pragma once
+#include "FrameArena.h"
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <string>
+#include <cstdint>
 
-bool findChessboardCorners(const cv::Mat& frame, const cv::Size& patternSize, std::vector<cv::Point2f>& corner_set);
+// Cost of the chessboard search and corner refinement; the defaults are the full-quality settings
+struct DetectionSettings {
+    float scale = 1.0f;          // The search runs on an image downscaled by this factor; corners are refined at full size
+    int subPixWindow = 11;       // Half size of the cornerSubPix search window
+    int subPixIterations = 30;   // Iteration limit of cornerSubPix
+};
 
+enum class BoardDetectorBackend {
+    Classic,      // cv::findChessboardCorners, then cornerSubPix
+    ClassicFast,  // The same with CALIB_CB_FAST_CHECK, which gives up quickly on frames without a board
+    Sector,       // cv::findChessboardCornersSB; its corners are already sub-pixel accurate
+    Precheck      // cv::checkChessboard on a small copy first; the classic search runs only if a board looks present
+};
+
+const char* boardDetectorName(BoardDetectorBackend backend);
+// Accepts "classic", "fast", "sb" and "precheck"
+bool parseBoardDetectorBackend(const std::string& name, BoardDetectorBackend& backend);
+
+struct BoardDetectorStats {
+    int64_t calls = 0;
+    int64_t found = 0;
+    int64_t prechecksRejected = 0;   // Images the pre-classifier turned away before the full search
+    double totalMs = 0.0;
+};
+
+// Finds the board in grayscale images with one of the backends. Detection never draws; call drawBoardCorners
+// only when the result is going to be shown.
+class BoardDetector {
+public:
+    explicit BoardDetector(const cv::Size& patternSize, BoardDetectorBackend backend = BoardDetectorBackend::Classic);
+
+    // Find the board and refine its corners to sub-pixel accuracy. Scratch images come from the arena when one is given.
+    bool detect(const cv::Mat& gray, std::vector<cv::Point2f>& corner_set, FrameArena* arena = nullptr);
+
+    void setBackend(BoardDetectorBackend newBackend) { backend = newBackend; }
+    BoardDetectorBackend detectorBackend() const { return backend; }
+    const cv::Size& pattern() const { return patternSize; }
+    const BoardDetectorStats& stats() const { return detectorStats; }
+
+    DetectionSettings settings;
+    int precheckWidth = 320;   // Width of the copy the pre-classifier looks at
+
+private:
+    bool search(const cv::Mat& gray, std::vector<cv::Point2f>& corner_set, cv::Mat& scaled);
+
+    cv::Size patternSize;
+    BoardDetectorBackend backend;
+    cv::Mat scaledGray, precheckGray;
+    BoardDetectorStats detectorStats;
+};
+
+// Draw detected corners onto a BGR frame, kept apart from detection so headless runs skip it
+void drawBoardCorners(cv::Mat& frame, const cv::Size& patternSize, const std::vector<cv::Point2f>& corner_set);
+
+// Convert to grayscale and detect with a one-off classic detector. The grayscale copy comes from the frame arena
+// when one is given, so a steady stream of frames does not allocate it.
+bool findChessboardCorners(const cv::Mat& frame, const cv::Size& patternSize, std::vector<cv::Point2f>& corner_set, FrameArena* arena = nullptr,
+    const DetectionSettings& settings = DetectionSettings(), BoardDetectorBackend backend = BoardDetectorBackend::Classic);
+
+// Counters describing how each frame's board was found
+struct TrackerStats {
+    int64_t frames = 0;        // Frames passed to the tracker
+    int64_t flowHits = 0;      // Board followed by optical flow from the previous frame
+    int64_t roiHits = 0;       // Board re-detected inside the padded region around the previous board
+    int64_t fullSearches = 0;  // Frames that fell back to a full-frame search
+    int64_t fullHits = 0;      // Full-frame searches that found the board
+    int64_t lost = 0;          // Frames without a board
+
+    // Share of frames with a board that were served without a full-frame search
+    double hitRate() const;
+    // Share of all frames that needed a full-frame search
+    double fallbackRate() const;
+};
+
+// Chessboard detector that follows the board from frame to frame instead of searching the whole image each time
+class ChessboardTracker {
+public:
+    explicit ChessboardTracker(const cv::Size& patternSize);
+
+    // Find the board in the frame and return true if found. Corners predicted from the
+    // expected pose seed the optical flow and centre the region search.
+    bool track(const cv::Mat& frame, std::vector<cv::Point2f>& corner_set, const std::vector<cv::Point2f>* predicted = nullptr);
+
+    // Forget the previous board so the next frame runs a full-frame search
+    void reset();
+
+    const TrackerStats& stats() const { return counters; }
+
+    float roiPadding = 0.25f;       // Padding around the previous board as a fraction of its larger side
+    float maxFlowError = 12.0f;     // Largest accepted mean optical flow error
+    double maxGridResidual = 2.0;   // Largest accepted deviation (pixels) of tracked corners from a planar grid
+    DetectionSettings settings;     // Search scale and corner refinement cost
+    BoardDetectorBackend backend = BoardDetectorBackend::Classic;   // Used for the region and full-frame searches
+
+private:
+    bool trackWithFlow(std::vector<cv::Point2f>& corner_set, const std::vector<cv::Point2f>* predicted);
+    cv::Rect searchRegion(const std::vector<cv::Point2f>& corners) const;
+    bool detectInRegion(const cv::Rect& region, std::vector<cv::Point2f>& corner_set);
+    void refineCorners(std::vector<cv::Point2f>& corner_set);
+
+    cv::Size patternSize;
+    std::vector<cv::Point2f> gridPoints;  // Ideal board grid used to check tracked corners
+    BoardDetector detector;
+    cv::Mat gray, prevGray;
+    std::vector<cv::Point2f> prevCorners, flowCorners;
+    std::vector<uchar> flowStatus;
+    std::vector<float> flowError;
+    bool hasPrevious = false;
+    TrackerStats counters;
+};
+
+void printTrackerStats(const TrackerStats& stats);
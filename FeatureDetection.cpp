@@ -1,4 +1,10 @@
 #include "FeatureDetection.h"
+#include "Profiler.h"
+#include "Timing.h"
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
 
 void detectHarrisCorners(const cv::Mat& frame) {
     cv::Mat gray;
@@ -29,4 +35,195 @@ void detectAndDrawFeatures(cv::Mat& frame) {
 
     // Draw keypoints
     cv::drawKeypoints(frame, keypoints, frame, cv::Scalar::all(-1), cv::DrawMatchesFlags::DEFAULT);
-}
\ No newline at end of file
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// ORB ignores this many pixels at the image border and needs them around every keypoint
+const int orbEdgeThreshold = 31;
+
+// cornerHarris(2, 3) reads one pixel around each output, and the 3x3 maximum test one more
+const int harrisPadding = 2;
+
+bool strongerResponse(const cv::KeyPoint& a, const cv::KeyPoint& b) {
+    return a.response > b.response;
+}
+
+} // namespace
+
+FeatureDetector::FeatureDetector(FeatureType type, cv::Size grid, int perCellBudget)
+    : type(type), grid(std::max(grid.width, 1), std::max(grid.height, 1)), perCellBudget(std::max(perCellBudget, 1)) {}
+
+void FeatureDetector::setPerCellBudget(int budget) {
+    budget = std::max(budget, 1);
+    if (budget == perCellBudget) {
+        return;
+    }
+    perCellBudget = budget;
+    for (Cell& cell : cells) {
+        if (cell.orb) {
+            cell.orb->setMaxFeatures(perCellBudget * 2);
+        }
+    }
+}
+
+void FeatureDetector::layoutCells(cv::Size imageSize) {
+    layoutSize = imageSize;
+    layoutType = type;
+    cells.resize(size_t(grid.area()));
+    cv::Rect image(0, 0, imageSize.width, imageSize.height);
+    for (int gy = 0; gy < grid.height; ++gy) {
+        for (int gx = 0; gx < grid.width; ++gx) {
+            Cell& cell = cells[gy * grid.width + gx];
+            int x0 = gx * imageSize.width / grid.width, x1 = (gx + 1) * imageSize.width / grid.width;
+            int y0 = gy * imageSize.height / grid.height, y1 = (gy + 1) * imageSize.height / grid.height;
+            cell.core = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+            int padding = type == FeatureType::ORB ? orbEdgeThreshold + 1 : harrisPadding;
+            cell.padded = cv::Rect(x0 - padding, y0 - padding, x1 - x0 + 2 * padding, y1 - y0 + 2 * padding) & image;
+            if (!cell.orb) {
+                // Twice the budget leaves enough after dropping keypoints in the padding; cells are small, so few levels
+                cell.orb = cv::ORB::create(perCellBudget * 2, 1.2f, 3, orbEdgeThreshold);
+            }
+        }
+    }
+}
+
+const std::vector<cv::KeyPoint>& FeatureDetector::detect(const cv::Mat& frame) {
+    PROFILE_SCOPE("detectFeatures");
+    Clock::time_point start = Clock::now();
+    keypoints.clear();
+    if (frame.cols < grid.width * 8 || frame.rows < grid.height * 8) {
+        return keypoints;  // Too small to give every cell some pixels
+    }
+    if (frame.channels() == 3) {
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        gray = frame;
+    }
+
+    // The padding differs between detector types, so the layout is redone when either changes
+    if (gray.size() != layoutSize || type != layoutType) {
+        layoutCells(gray.size());
+    }
+
+    int cellCount = int(cells.size());
+    if (type == FeatureType::ORB) {
+        cv::parallel_for_(cv::Range(0, cellCount), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; ++i) detectORB(cells[i]);
+        });
+    }
+    else {
+        // The threshold is relative to the response range of the whole frame, so responses come first
+        cv::parallel_for_(cv::Range(0, cellCount), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; ++i) harrisResponse(cells[i]);
+        });
+        double minResponse = cells[0].minResponse, maxResponse = cells[0].maxResponse;
+        for (const Cell& cell : cells) {
+            minResponse = std::min(minResponse, cell.minResponse);
+            maxResponse = std::max(maxResponse, cell.maxResponse);
+        }
+        float threshold = float(minResponse + (maxResponse - minResponse) * harrisQuality);
+        cv::parallel_for_(cv::Range(0, cellCount), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; ++i) harrisMaxima(cells[i], threshold);
+        });
+    }
+
+    int cellsUsed = 0;
+    for (const Cell& cell : cells) {
+        keypoints.insert(keypoints.end(), cell.keypoints.begin(), cell.keypoints.end());
+        cellsUsed += cell.keypoints.empty() ? 0 : 1;
+    }
+
+    double ms = elapsedMs(start, Clock::now());
+    featureStats.frames++;
+    featureStats.totalMs += ms;
+    featureStats.maxMs = std::max(featureStats.maxMs, ms);
+    featureStats.lastKeypoints = keypoints.size();
+    featureStats.lastCellsUsed = cellsUsed;
+    return keypoints;
+}
+
+void FeatureDetector::describe(std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) {
+    if (gray.empty() || keypoints.empty()) {
+        descriptors.release();
+        return;
+    }
+    if (!describer) {
+        describer = cv::ORB::create();
+    }
+    describer->compute(gray, keypoints, descriptors);
+}
+
+void FeatureDetector::detectORB(Cell& cell) {
+    cell.keypoints.clear();
+    cell.orb->detect(gray(cell.padded), cell.keypoints);
+
+    // Keep keypoints whose centre lies in this cell so neighbouring cells never report the same one
+    cv::Point2f offset(float(cell.padded.x), float(cell.padded.y));
+    size_t kept = 0;
+    for (cv::KeyPoint& keypoint : cell.keypoints) {
+        keypoint.pt += offset;
+        if (cell.core.contains(cv::Point(int(keypoint.pt.x), int(keypoint.pt.y)))) {
+            cell.keypoints[kept++] = keypoint;
+        }
+    }
+    cell.keypoints.resize(kept);
+    keepStrongest(cell);
+}
+
+void FeatureDetector::harrisResponse(Cell& cell) {
+    cv::cornerHarris(gray(cell.padded), cell.response, 2, 3, 0.04);
+    cv::Rect core = cell.core - cell.padded.tl();
+    cv::minMaxLoc(cell.response(core), &cell.minResponse, &cell.maxResponse);
+}
+
+void FeatureDetector::harrisMaxima(Cell& cell, float threshold) {
+    cell.keypoints.clear();
+
+    // A corner is a pixel above the threshold that equals the maximum of its 3x3 neighbourhood.
+    // dilate, compare and bitwise_and all run on whole rows with SIMD instead of per-pixel at<float>.
+    cv::dilate(cell.response, cell.dilated, cv::Mat());
+    cv::Rect core = cell.core - cell.padded.tl();
+    cv::compare(cell.response(core), cell.dilated(core), cell.isMax, cv::CMP_GE);
+    cv::compare(cell.response(core), double(threshold), cell.above, cv::CMP_GT);
+    cv::bitwise_and(cell.isMax, cell.above, cell.isMax);
+    cv::findNonZero(cell.isMax, cell.locations);
+
+    for (const cv::Point& location : cell.locations) {
+        float response = cell.response.at<float>(location.y + core.y, location.x + core.x);
+        cell.keypoints.emplace_back(cv::Point2f(float(location.x + cell.core.x), float(location.y + cell.core.y)), 10.0f, -1.0f, response);
+    }
+    keepStrongest(cell);
+}
+
+void FeatureDetector::keepStrongest(Cell& cell) {
+    if (cell.keypoints.size() > size_t(perCellBudget)) {
+        std::nth_element(cell.keypoints.begin(), cell.keypoints.begin() + perCellBudget, cell.keypoints.end(), strongerResponse);
+        cell.keypoints.resize(perCellBudget);
+    }
+}
+
+void drawFeatures(cv::Mat& frame, const std::vector<cv::KeyPoint>& keypoints, FeatureType type) {
+    if (type == FeatureType::ORB) {
+        // Drawing over the frame avoids the copy drawKeypoints makes by default
+        cv::drawKeypoints(frame, keypoints, frame, cv::Scalar::all(-1), cv::DrawMatchesFlags::DRAW_OVER_OUTIMG);
+    }
+    else {
+        for (const cv::KeyPoint& keypoint : keypoints) {
+            cv::circle(frame, keypoint.pt, 5, cv::Scalar(0), 2, 8, 0);
+        }
+    }
+}
+
+void printFeatureStats(const FeatureStats& stats, cv::Size grid) {
+    if (stats.frames == 0) {
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "[features] " << stats.frames << " frames, detection mean " << stats.meanMs() << " ms (max " << stats.maxMs
+        << "), last frame " << stats.lastKeypoints << " keypoints in " << stats.lastCellsUsed << " of " << grid.area() << " cells" << std::endl;
+    std::cout << std::defaultfloat;
+}
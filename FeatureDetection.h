@@ -3,10 +3,85 @@
 
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <cstdint>
 
+// Function to detect Harris corners over the whole frame and circle them (per-call reference for FeatureDetector)
 void detectHarrisCorners(const cv::Mat& frame);
 
-// Function to detect and draw features on the frame
+// Function to detect and draw features on the frame (per-call reference for FeatureDetector)
 void detectAndDrawFeatures(cv::Mat& frame);
 
-#endif // FEATURE_DETECTION_H
\ No newline at end of file
+enum class FeatureType {
+    ORB,     // ORB keypoints drawn with drawKeypoints
+    Harris   // Harris corner maxima drawn as circles
+};
+
+struct FeatureStats {
+    int64_t frames = 0;
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+    size_t lastKeypoints = 0;
+    int lastCellsUsed = 0;   // Cells that contributed at least one keypoint in the last frame
+
+    double meanMs() const { return frames > 0 ? totalMs / frames : 0.0; }
+};
+
+// Keeps its detectors and buffers between frames. The frame is split into a grid of cells that
+// are detected in parallel, and each cell keeps at most perCellBudget of its strongest keypoints
+// so the features spread over the whole image instead of clustering on the most textured part.
+class FeatureDetector {
+public:
+    explicit FeatureDetector(FeatureType type = FeatureType::ORB, cv::Size grid = cv::Size(8, 6), int perCellBudget = 16);
+
+    // Detect keypoints in a BGR or grayscale frame; the returned buffer stays valid until the next call
+    const std::vector<cv::KeyPoint>& detect(const cv::Mat& frame);
+
+    // Compute ORB descriptors on the last detected frame. Keypoints too close to the border are removed.
+    void describe(std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors);
+
+    void setType(FeatureType newType) { type = newType; }
+    // Change how many keypoints each cell keeps; ORB cells also search for fewer
+    void setPerCellBudget(int budget);
+    int cellBudget() const { return perCellBudget; }
+    FeatureType featureType() const { return type; }
+    cv::Size gridSize() const { return grid; }
+    const FeatureStats& stats() const { return featureStats; }
+
+    double harrisQuality = 200.0 / 255.0;  // Fraction of the response range a corner must exceed, as in detectHarrisCorners
+
+private:
+    struct Cell {
+        cv::Rect core;        // Pixels this cell owns
+        cv::Rect padded;      // Core plus the border the detector needs to see
+        cv::Ptr<cv::ORB> orb;
+        cv::Mat response, dilated, isMax, above;
+        std::vector<cv::Point> locations;
+        std::vector<cv::KeyPoint> keypoints;
+        double minResponse = 0.0, maxResponse = 0.0;
+    };
+
+    void layoutCells(cv::Size imageSize);
+    void detectORB(Cell& cell);
+    void harrisResponse(Cell& cell);
+    void harrisMaxima(Cell& cell, float threshold);
+    void keepStrongest(Cell& cell);
+
+    FeatureType type;
+    cv::Size grid;
+    int perCellBudget;
+    cv::Size layoutSize;
+    FeatureType layoutType = FeatureType::ORB;
+    cv::Mat gray;
+    cv::Ptr<cv::ORB> describer;
+    std::vector<Cell> cells;
+    std::vector<cv::KeyPoint> keypoints;
+    FeatureStats featureStats;
+};
+
+// Draw keypoints the way the matching per-call function does
+void drawFeatures(cv::Mat& frame, const std::vector<cv::KeyPoint>& keypoints, FeatureType type);
+
+// Print the mean detection time and how evenly the last frame's keypoints were spread
+void printFeatureStats(const FeatureStats& stats, cv::Size grid);
+
+#endif // FEATURE_DETECTION_H
@@ -0,0 +1,185 @@
+#include "FeaturePoseTracker.h"
+#include "Profiler.h"
+#include "CameraCalibration.h"
+#include <climits>
+#include <iostream>
+
+double FeatureTrackerStats::featureShare() const {
+    int64_t withPose = boardPoses + featurePoses;
+    return withPose > 0 ? double(featurePoses) / withPose : 0.0;
+}
+
+FeaturePoseTracker::FeaturePoseTracker(const cv::Size& patternSize)
+    : detector(FeatureType::ORB), boardPoints(boardObjectPoints(patternSize)) {
+    for (const cv::Vec3f& point : boardPoints) {
+        boardPlanePoints.push_back(cv::Point2f(point[0], point[1]));
+    }
+}
+
+bool FeaturePoseTracker::shouldDetectBoard() const {
+    return !onFeatures || framesOnFeatures % retryInterval == 0;
+}
+
+void FeaturePoseTracker::beginFrame(bool detectBoard) {
+    counters.frames++;
+    if (detectBoard) {
+        counters.boardDetections++;
+    }
+    framesSinceAnchor++;
+}
+
+void FeaturePoseTracker::reset() {
+    anchorDescriptors.release();
+    anchorPoints.clear();
+    lastRvec.release();
+    lastTvec.release();
+    onFeatures = false;
+    framesOnFeatures = 0;
+    lostFrames = 0;
+}
+
+const cv::Mat& FeaturePoseTracker::grayCopy(const cv::Mat& frame) {
+    if (frame.channels() == 3) {
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        frame.copyTo(gray);
+    }
+    return gray;
+}
+
+void FeaturePoseTracker::boardFound(const cv::Mat& frame, const std::vector<cv::Point2f>& corners, const cv::Mat& rvec, const cv::Mat& tvec) {
+    counters.boardPoses++;
+    rvec.copyTo(lastRvec);
+    tvec.copyTo(lastTvec);
+    onFeatures = false;
+    framesOnFeatures = 0;
+    lostFrames = 0;
+    if (!anchorPoints.empty() && framesSinceAnchor < anchorInterval) {
+        return;
+    }
+
+    // Map the features from the image onto the board plane with the homography of the visible corners
+    cv::Mat H = cv::findHomography(corners, boardPlanePoints);
+    if (H.empty()) {
+        return;
+    }
+    const std::vector<cv::KeyPoint>& detected = detector.detect(grayCopy(frame));
+    keypoints.assign(detected.begin(), detected.end());
+    detector.describe(keypoints, descriptors);
+    if (keypoints.empty()) {
+        return;
+    }
+    imagePoints.clear();
+    for (const cv::KeyPoint& keypoint : keypoints) {
+        imagePoints.push_back(keypoint.pt);
+    }
+    cv::perspectiveTransform(imagePoints, planePoints, H);
+
+    // Keep features on the board, including its outer ring of squares (x runs right, y runs up from the first corner)
+    float maxX = boardPlanePoints.back().x + 1.0f, minY = boardPlanePoints.back().y - 1.0f;
+    anchorPoints.clear();
+    anchorDescriptors.release();
+    for (size_t i = 0; i < planePoints.size(); ++i) {
+        const cv::Point2f& p = planePoints[i];
+        if (p.x >= -1.0f && p.x <= maxX && p.y >= minY && p.y <= 1.0f) {
+            anchorPoints.push_back(cv::Point3f(p.x, p.y, 0.0f));
+            anchorDescriptors.push_back(descriptors.row(int(i)));
+        }
+    }
+    framesSinceAnchor = 0;
+    counters.anchorings++;
+    counters.lastAnchors = anchorPoints.size();
+}
+
+bool FeaturePoseTracker::trackFeatures(const cv::Mat& frame, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs,
+    cv::Mat& rvec, cv::Mat& tvec, std::vector<cv::Point2f>& corner_set, std::vector<cv::Point2f>& inlierPoints) {
+    PROFILE_SCOPE("trackFeatures");
+    auto fail = [this] {
+        onFeatures = false;
+        framesOnFeatures = 0;
+        counters.lost++;
+        if (++lostFrames >= maxLostFrames) {
+            reset();
+        }
+        return false;
+    };
+    if (anchorPoints.size() < size_t(minInliers) || !hasPose()) {
+        return fail();
+    }
+
+    const std::vector<cv::KeyPoint>& detected = detector.detect(grayCopy(frame));
+    keypoints.assign(detected.begin(), detected.end());
+    detector.describe(keypoints, descriptors);
+    if (keypoints.size() < size_t(minInliers)) {
+        return fail();
+    }
+
+    // Only compare each anchor with keypoints near where the last pose puts it. The board's corners
+    // all look alike, so position is what tells them apart.
+    cv::projectPoints(anchorPoints, lastRvec, lastTvec, cameraMatrix, distCoeffs, predicted);
+    float radiusSquared = searchRadius * searchRadius;
+    matchedObjects.clear();
+    matchedImages.clear();
+    for (size_t a = 0; a < anchorPoints.size(); ++a) {
+        int best = INT_MAX, second = INT_MAX, bestIndex = -1;
+        for (size_t k = 0; k < keypoints.size(); ++k) {
+            cv::Point2f offset = keypoints[k].pt - predicted[a];
+            if (offset.x * offset.x + offset.y * offset.y > radiusSquared) continue;
+            int distance = cv::hal::normHamming(anchorDescriptors.ptr<uchar>(int(a)), descriptors.ptr<uchar>(int(k)), descriptors.cols);
+            if (distance < best) {
+                second = best;
+                best = distance;
+                bestIndex = int(k);
+            }
+            else if (distance < second) {
+                second = distance;
+            }
+        }
+        // Reject matches that are weak or barely better than the runner-up
+        if (bestIndex >= 0 && best <= maxHammingDistance && (second == INT_MAX || best * 10 < second * 9)) {
+            matchedObjects.push_back(anchorPoints[a]);
+            matchedImages.push_back(keypoints[bestIndex].pt);
+        }
+    }
+    if (matchedObjects.size() < size_t(minInliers)) {
+        return fail();
+    }
+
+    // Start from the last pose so RANSAC only has to correct a frame's worth of motion
+    lastRvec.copyTo(rvec);
+    lastTvec.copyTo(tvec);
+    if (!cv::solvePnPRansac(matchedObjects, matchedImages, cameraMatrix, distCoeffs, rvec, tvec, true, 100, reprojectionError, 0.99, inliers)
+        || inliers.size() < size_t(minInliers)) {
+        return fail();
+    }
+
+    // Predict the board's corners so the overlays can be drawn as if it had been found
+    cv::projectPoints(boardPoints, rvec, tvec, cameraMatrix, distCoeffs, corner_set);
+    inlierPoints.clear();
+    for (int i : inliers) {
+        inlierPoints.push_back(matchedImages[i]);
+    }
+
+    rvec.copyTo(lastRvec);
+    tvec.copyTo(lastTvec);
+    onFeatures = true;
+    framesOnFeatures++;
+    lostFrames = 0;
+    counters.featurePoses++;
+    counters.lastInliers = inliers.size();
+    return true;
+}
+
+void drawTrackedFeatures(cv::Mat& frame, const std::vector<cv::Point2f>& inlierPoints) {
+    for (const cv::Point2f& point : inlierPoints) {
+        cv::circle(frame, point, 3, cv::Scalar(0, 255, 255), 1);
+    }
+}
+
+void printFeatureTrackerStats(const FeatureTrackerStats& stats) {
+    std::cout << "Feature pose tracking: " << stats.frames << " frames, chessboard detector run on " << stats.boardDetections << ", "
+        << stats.boardPoses << " board poses, " << stats.featurePoses << " feature poses, " << stats.lost << " lost" << std::endl;
+    std::cout << "  " << stats.featureShare() * 100.0 << "% of poses from features, " << stats.anchorings << " anchorings (last "
+        << stats.lastAnchors << " anchors, " << stats.lastInliers << " inliers)" << std::endl;
+}
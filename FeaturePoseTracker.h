@@ -0,0 +1,89 @@
+#pragma once
+#include "FeatureDetection.h"
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstdint>
+
+// Counters describing where each frame's pose came from
+struct FeatureTrackerStats {
+    int64_t frames = 0;             // Frames passed to the tracker
+    int64_t boardDetections = 0;    // Frames on which the chessboard detector ran
+    int64_t boardPoses = 0;         // Poses solved from chessboard corners
+    int64_t anchorings = 0;         // Times the board-plane features were re-anchored
+    int64_t featurePoses = 0;       // Poses solved from anchored features while the board was not found
+    int64_t lost = 0;               // Frames without any pose
+    size_t lastAnchors = 0;
+    size_t lastInliers = 0;
+
+    // Share of frames with a pose that came from features
+    double featureShare() const;
+};
+
+// Keeps the board pose when the chessboard is occluded or lost. While the board is found, ORB
+// features inside it are anchored to the board plane. When it is not found, those anchors are matched
+// near their predicted positions and the pose is solved with RANSAC PnP. The chessboard detector then
+// only runs every retryInterval frames until the board is found again.
+class FeaturePoseTracker {
+public:
+    explicit FeaturePoseTracker(const cv::Size& patternSize);
+
+    // True if the chessboard detector should run on this frame
+    bool shouldDetectBoard() const;
+
+    // Start a frame; detectBoard tells whether the chessboard detector is run on it
+    void beginFrame(bool detectBoard);
+
+    // The board was found and its pose solved; re-anchor features if the anchors are missing or stale
+    void boardFound(const cv::Mat& frame, const std::vector<cv::Point2f>& corners, const cv::Mat& rvec, const cv::Mat& tvec);
+
+    // The board was not found: solve the pose from the anchored features, return the inlier feature positions,
+    // and predict where the board's corners are. Returns false when there are too few matches.
+    bool trackFeatures(const cv::Mat& frame, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs,
+        cv::Mat& rvec, cv::Mat& tvec, std::vector<cv::Point2f>& corner_set, std::vector<cv::Point2f>& inlierPoints);
+
+    // Drop the anchors and the last pose
+    void reset();
+
+    const FeatureTrackerStats& stats() const { return counters; }
+
+    int retryInterval = 10;        // Frames between chessboard retries while the pose comes from features
+    int anchorInterval = 30;       // Frames before the anchors are refreshed from a visible board
+    int maxLostFrames = 15;        // Consecutive failed frames before the anchors are dropped
+    int minInliers = 12;           // Fewest RANSAC inliers accepted as a pose
+    float searchRadius = 40.0f;    // Pixels around an anchor's predicted position searched for its match
+    int maxHammingDistance = 64;   // Largest accepted descriptor distance
+    float reprojectionError = 4.0f;
+
+private:
+    bool hasPose() const { return !lastRvec.empty(); }
+    // Features are detected on a private grayscale copy, so nothing drawn on the frame later can end up in the anchors
+    const cv::Mat& grayCopy(const cv::Mat& frame);
+
+    FeatureDetector detector;
+    std::vector<cv::Vec3f> boardPoints;        // Board corners in board units, as used for solvePnP
+    std::vector<cv::Point2f> boardPlanePoints; // The same corners in the board plane
+
+    // Anchors: one descriptor row per feature and its position on the board plane (z = 0)
+    cv::Mat anchorDescriptors;
+    std::vector<cv::Point3f> anchorPoints;
+
+    cv::Mat lastRvec, lastTvec;
+    cv::Mat gray;
+    std::vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;
+    std::vector<cv::Point2f> predicted, planePoints, imagePoints;
+    std::vector<cv::Point3f> matchedObjects;
+    std::vector<cv::Point2f> matchedImages;
+    std::vector<int> inliers;
+
+    bool onFeatures = false;       // The last pose came from features
+    int framesOnFeatures = 0;
+    int framesSinceAnchor = 0;
+    int lostFrames = 0;
+    FeatureTrackerStats counters;
+};
+
+// Circle the features a tracked pose was solved from
+void drawTrackedFeatures(cv::Mat& frame, const std::vector<cv::Point2f>& inlierPoints);
+
+void printFeatureTrackerStats(const FeatureTrackerStats& stats);
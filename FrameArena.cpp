@@ -0,0 +1,93 @@
+#include "FrameArena.h"
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+FrameArena::FrameArena(size_t initialBytes) {
+    addBlock(initialBytes);
+}
+
+FrameArena::~FrameArena() {
+    for (Block& block : blocks) {
+        delete[] block.data;
+    }
+}
+
+void FrameArena::addBlock(size_t minimumBytes) {
+    size_t size = std::max(minimumBytes, blocks.empty() ? size_t(4096) : blocks.back().size * 2);
+    blocks.push_back({ new char[size], size });
+    arenaStats.blockAllocations++;
+    arenaStats.capacity += size;
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment) {
+    while (true) {
+        Block& block = blocks[current];
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+        size_t aligned = ((base + offset + alignment - 1) & ~uintptr_t(alignment - 1)) - base;
+        if (aligned + bytes <= block.size) {
+            usedBytes += aligned + bytes - offset;
+            offset = aligned + bytes;
+            return block.data + aligned;
+        }
+        // Move on to the next block, adding one large enough for this request if there is none
+        usedBytes += block.size - offset;
+        if (current + 1 == blocks.size()) {
+            addBlock(bytes + alignment);
+        }
+        current++;
+        offset = 0;
+    }
+}
+
+cv::Mat FrameArena::mat(int rows, int cols, int type) {
+    size_t step = size_t(cols) * CV_ELEM_SIZE(type);
+    return cv::Mat(rows, cols, type, allocate(step * rows, 64), step);
+}
+
+void FrameArena::reset() {
+    arenaStats.frames++;
+    arenaStats.peakBytes = std::max(arenaStats.peakBytes, usedBytes);
+
+    // A frame that spilled into extra blocks gets one block big enough for all of them next time
+    if (blocks.size() > 1) {
+        size_t total = arenaStats.capacity;
+        for (Block& block : blocks) {
+            delete[] block.data;
+        }
+        blocks.clear();
+        arenaStats.capacity = 0;
+        addBlock(total);
+    }
+    current = 0;
+    offset = 0;
+    usedBytes = 0;
+}
+
+void FrameAllocationStats::add(const AllocationCount& used) {
+    frames++;
+    allocations += used.allocations;
+    bytes += used.bytes;
+    if (frames > warmupFrames) {
+        steadyFrames++;
+        steadyAllocations += used.allocations;
+        steadyMaxAllocations = std::max(steadyMaxAllocations, used.allocations);
+    }
+}
+
+void printFrameAllocationStats(const std::string& label, const FrameAllocationStats& stats, const FrameArenaStats& arena) {
+    if (stats.frames == 0) {
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "[allocations] " << label << ": " << double(stats.allocations) / stats.frames << " heap allocations per frame ("
+        << double(stats.bytes) / stats.frames / 1024.0 << " KB)";
+    if (stats.steadyFrames > 0) {
+        std::cout << ", after " << stats.warmupFrames << " warm-up frames " << double(stats.steadyAllocations) / stats.steadyFrames
+            << " per frame (worst " << stats.steadyMaxAllocations << ")";
+    }
+    std::cout << std::endl;
+    std::cout << "  frame arena: " << arena.capacity / 1024 << " KB reserved, peak " << arena.peakBytes / 1024.0
+        << " KB in one frame, " << arena.blockAllocations << " block allocations" << std::endl;
+    std::cout << std::defaultfloat;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "AllocationCounter.h"
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+struct FrameArenaStats {
+    int64_t frames = 0;
+    int64_t blockAllocations = 0;   // Heap blocks the arena itself has allocated
+    size_t peakBytes = 0;           // Most memory handed out in one frame
+    size_t capacity = 0;            // Bytes currently reserved
+};
+
+// Bump allocator for buffers that only live for one frame. Nothing is freed individually; reset() at the start
+// of each frame makes the whole block available again. When a frame outgrows the block, extra blocks are taken
+// from the heap and merged into one larger block at the next reset, so a steady stream of frames needs none.
+class FrameArena {
+public:
+    explicit FrameArena(size_t initialBytes = 256 * 1024);
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T* allocateArray(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // A Mat header over arena memory, valid until the next reset. OpenCV functions that write into a Mat
+    // of the right size and type reuse its buffer instead of allocating one.
+    cv::Mat mat(int rows, int cols, int type);
+    cv::Mat mat(cv::Size size, int type) { return mat(size.height, size.width, type); }
+
+    // Start a new frame; every pointer and Mat handed out before becomes invalid
+    void reset();
+
+    size_t used() const { return usedBytes; }
+    const FrameArenaStats& stats() const { return arenaStats; }
+
+private:
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    void addBlock(size_t minimumBytes);
+
+    std::vector<Block> blocks;
+    size_t current = 0;      // Block being filled
+    size_t offset = 0;       // Next free byte in that block
+    size_t usedBytes = 0;    // Handed out this frame, including alignment padding
+    FrameArenaStats arenaStats;
+};
+
+// Heap allocations per frame of one stage, counted on the stage's thread
+struct FrameAllocationStats {
+    int64_t frames = 0;
+    uint64_t allocations = 0, bytes = 0;
+    int64_t steadyFrames = 0;             // Frames after the warm-up
+    uint64_t steadyAllocations = 0;
+    uint64_t steadyMaxAllocations = 0;    // Worst single frame after the warm-up
+    int64_t warmupFrames = 30;
+
+    void add(const AllocationCount& used);
+};
+
+// Resets an arena for a new frame and records the heap allocations made until the end of the scope
+class FrameAllocationScope {
+public:
+    FrameAllocationScope(FrameArena& arena, FrameAllocationStats& stats) : stats(stats), before(threadAllocationCount()) {
+        arena.reset();
+    }
+    ~FrameAllocationScope() {
+        stats.add(threadAllocationCount() - before);
+    }
+    FrameAllocationScope(const FrameAllocationScope&) = delete;
+    FrameAllocationScope& operator=(const FrameAllocationScope&) = delete;
+
+private:
+    FrameAllocationStats& stats;
+    AllocationCount before;
+};
+
+// Print the mean allocations per frame overall and after the warm-up, plus the arena's size and growth
+void printFrameAllocationStats(const std::string& label, const FrameAllocationStats& stats, const FrameArenaStats& arena);
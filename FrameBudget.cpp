@@ -0,0 +1,134 @@
+#include "FrameBudget.h"
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// Cheapest last. Refinement is cut before the search resolution because it costs the least accuracy.
+const DetectQuality detectLadder[] = {
+    { { 1.0f, 11, 30 }, 16 },
+    { { 1.0f, 7, 15 }, 16 },
+    { { 1.0f, 5, 8 }, 8 },
+    { { 0.75f, 5, 8 }, 8 },
+    { { 0.5f, 5, 5 }, 4 },
+};
+
+const RenderQuality renderLadder[] = {
+    { true, 64.0f },
+    { false, 64.0f },
+    { false, 128.0f },
+    { false, 256.0f },
+    { false, 512.0f },
+};
+
+const int detectLevels = int(sizeof(detectLadder) / sizeof(detectLadder[0]));
+const int renderLevels = int(sizeof(renderLadder) / sizeof(renderLadder[0]));
+
+double smooth(double previous, double sample, double weight) {
+    return previous > 0.0 ? previous + weight * (sample - previous) : sample;
+}
+
+} // namespace
+
+FrameBudgetGovernor::FrameBudgetGovernor(double targetMs, bool pipelined) : target(targetMs), pipelined(pipelined) {}
+
+DetectQuality FrameBudgetGovernor::detectQuality() const {
+    return detectLadder[detectStep.load(std::memory_order_relaxed)];
+}
+
+RenderQuality FrameBudgetGovernor::renderQuality() const {
+    return renderLadder[renderStep.load(std::memory_order_relaxed)];
+}
+
+void FrameBudgetGovernor::reportDetect(double ms) {
+    detectMs.store(smooth(detectMs.load(std::memory_order_relaxed), ms, smoothing), std::memory_order_relaxed);
+}
+
+void FrameBudgetGovernor::reportRender(double ms) {
+    renderMs = smooth(renderMs, ms, smoothing);
+    double d = detectMs.load(std::memory_order_relaxed);
+    double workMs = pipelined ? std::max(d, renderMs) : d + renderMs;
+
+    budgetStats.frames++;
+    if (workMs > target) {
+        budgetStats.overBudgetFrames++;
+    }
+    if (++framesSinceChange < settleFrames) {
+        return;
+    }
+
+    if (workMs > target) {
+        // Take time from the stage that costs the most, or from the other one once it is at its cheapest
+        headroomFrames = 0;
+        bool detectCanDrop = detectStep.load() + 1 < detectLevels, renderCanDrop = renderStep.load() + 1 < renderLevels;
+        if (detectCanDrop && (d >= renderMs || !renderCanDrop)) {
+            adjust(true, 1, workMs);
+        }
+        else if (renderCanDrop) {
+            adjust(false, 1, workMs);
+        }
+    }
+    else if (workMs < headroom * target && (detectStep.load() > 0 || renderStep.load() > 0)) {
+        // Give quality back to the cheaper stage first, since it has the most room to grow
+        if (++headroomFrames >= upgradeFrames) {
+            headroomFrames = 0;
+            bool upgradeDetect = detectStep.load() > 0 && (d <= renderMs || renderStep.load() == 0);
+            adjust(upgradeDetect, -1, workMs);
+        }
+    }
+    else {
+        headroomFrames = 0;
+    }
+}
+
+void FrameBudgetGovernor::adjust(bool detect, int step, double workMs) {
+    std::atomic<int>& level = detect ? detectStep : renderStep;
+    int from = level.load();
+    int to = from + step;
+    level.store(to);
+    framesSinceChange = 0;
+
+    if (step > 0) {
+        budgetStats.downgrades++;
+    }
+    else {
+        budgetStats.upgrades++;
+    }
+    budgetStats.maxDetectLevel = std::max(budgetStats.maxDetectLevel, detectStep.load());
+    budgetStats.maxRenderLevel = std::max(budgetStats.maxRenderLevel, renderStep.load());
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "[budget] frame " << budgetStats.frames << ": work " << workMs << " ms " << (step > 0 ? "over" : "well under")
+        << " the " << target << " ms target (detect " << detectMs.load() << " ms, render " << renderMs << " ms), "
+        << (detect ? "detect" : "render") << " level " << from << " -> " << to << ": "
+        << (detect ? describeDetectQuality(detectLadder[to]) : describeRenderQuality(renderLadder[to])) << std::endl;
+    std::cout << std::defaultfloat;
+}
+
+std::string describeDetectQuality(const DetectQuality& quality) {
+    std::ostringstream out;
+    out << "search scale " << quality.detection.scale << ", subpixel window " << quality.detection.subPixWindow
+        << ", " << quality.detection.subPixIterations << " iterations, " << quality.featuresPerCell << " features per cell";
+    return out.str();
+}
+
+std::string describeRenderQuality(const RenderQuality& quality) {
+    std::ostringstream out;
+    out << (quality.drawVertices ? "vertex dots on" : "vertex dots off") << ", " << quality.lodPixelsPerTriangle << " pixels per triangle";
+    return out.str();
+}
+
+void printFrameBudgetStats(const FrameBudgetGovernor& governor) {
+    const FrameBudgetStats& stats = governor.stats();
+    if (stats.frames == 0) {
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Frame budget " << governor.targetMs() << " ms: " << 100.0 * stats.overBudgetFrames / stats.frames << "% of "
+        << stats.frames << " frames over, " << stats.downgrades << " downgrades, " << stats.upgrades << " upgrades" << std::endl;
+    std::cout << "  final detect level " << governor.detectLevel() << " (worst " << stats.maxDetectLevel << "), render level "
+        << governor.renderLevel() << " (worst " << stats.maxRenderLevel << ")" << std::endl;
+    std::cout << std::defaultfloat;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "ChessboardDetection.h"
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+// Quality knobs of the detection stage at one governor level
+struct DetectQuality {
+    DetectionSettings detection;
+    int featuresPerCell = 16;
+};
+
+// Quality knobs of the render stage at one governor level
+struct RenderQuality {
+    bool drawVertices = true;
+    float lodPixelsPerTriangle = 64.0f;
+};
+
+struct FrameBudgetStats {
+    int64_t frames = 0;
+    int64_t overBudgetFrames = 0;   // Frames whose stage work exceeded the target
+    int64_t downgrades = 0;
+    int64_t upgrades = 0;
+    int maxDetectLevel = 0, maxRenderLevel = 0;
+};
+
+// Keeps the frame time under a target by trading quality for time. Each stage has a ladder of levels, from
+// full quality at level 0 to the cheapest settings at the top. The governor smooths the measured stage times,
+// and when the frame's work runs over the target it steps the more expensive stage one level down the ladder.
+// When there has been clear headroom for a while, it steps the cheaper stage back up. Every change is logged.
+// Stage times are reported from the stage's own thread, and each stage reads its own settings, so the pipelined
+// loop needs no locks.
+class FrameBudgetGovernor {
+public:
+    // pipelined: the stages overlap, so the frame costs the slower stage rather than the sum of both
+    FrameBudgetGovernor(double targetMs, bool pipelined);
+
+    // Detection thread: the settings to use for this frame and the time the stage took
+    DetectQuality detectQuality() const;
+    void reportDetect(double ms);
+
+    // Render thread: the settings to use for this frame, the time the stage took, and one adjustment step
+    RenderQuality renderQuality() const;
+    void reportRender(double ms);
+
+    double targetMs() const { return target; }
+    int detectLevel() const { return detectStep.load(); }
+    int renderLevel() const { return renderStep.load(); }
+    const FrameBudgetStats& stats() const { return budgetStats; }
+
+    double smoothing = 0.1;    // Weight of the newest sample in the smoothed stage times
+    double headroom = 0.7;     // Upgrade once the work stays below this fraction of the target
+    int settleFrames = 15;     // Frames to wait after a change before judging its effect
+    int upgradeFrames = 60;    // Frames of headroom needed before an upgrade
+
+private:
+    void adjust(bool detect, int step, double workMs);
+
+    double target;
+    bool pipelined;
+    std::atomic<int> detectStep{0}, renderStep{0};
+    std::atomic<double> detectMs{0.0};
+    double renderMs = 0.0;
+    int framesSinceChange = 0;
+    int headroomFrames = 0;
+    FrameBudgetStats budgetStats;
+};
+
+// Describe a ladder level's settings, e.g. for the adjustment log
+std::string describeDetectQuality(const DetectQuality& quality);
+std::string describeRenderQuality(const RenderQuality& quality);
+
+void printFrameBudgetStats(const FrameBudgetGovernor& governor);
@@ -0,0 +1,218 @@
+#include "FramePipeline.h"
+#include "Profiler.h"
+#include "Timing.h"
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+} // namespace
+
+FrameQueue::FrameQueue(size_t capacity) : ring(std::max<size_t>(capacity, 1)) {}
+
+bool FrameQueue::push(int slot, int* evicted) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (evicted) {
+        *evicted = -1;
+        if (!closed && count == ring.size()) {
+            // Drop the stalest frame so the consumer always sees the newest ones
+            *evicted = ring[head];
+            head = (head + 1) % ring.size();
+            --count;
+        }
+    }
+    else {
+        notFull.wait(lock, [this] { return closed || count < ring.size(); });
+    }
+    if (closed) {
+        return false;
+    }
+    ring[(head + count) % ring.size()] = slot;
+    ++count;
+    notEmpty.notify_one();
+    return true;
+}
+
+bool FrameQueue::pop(int& slot) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this] { return closed || count > 0; });
+    if (count == 0) {
+        return false;
+    }
+    slot = ring[head];
+    head = (head + 1) % ring.size();
+    --count;
+    notFull.notify_one();
+    return true;
+}
+
+void FrameQueue::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    notEmpty.notify_all();
+    notFull.notify_all();
+}
+
+void StageTiming::add(double ms) {
+    totalMs += ms;
+    maxMs = std::max(maxMs, ms);
+    ++count;
+}
+
+PipelineStats runSerialLoop(cv::VideoCapture& cap, const DetectStage& detect, const RenderStage& render) {
+    PipelineStats stats;
+    FrameSlot slot;
+    const Clock::time_point loopStart = Clock::now();
+
+    for (int64_t frameIndex = 0;; ++frameIndex) {
+        PROFILE_SCOPE("frame");
+        Clock::time_point t0 = Clock::now();
+        {
+            PROFILE_SCOPE("capture");
+            cap >> slot.frame;
+        }
+        if (slot.frame.empty()) break;
+        slot.frameIndex = frameIndex;
+        slot.captureTime = t0;
+        Clock::time_point t1 = Clock::now();
+        {
+            PROFILE_SCOPE("detect");
+            detect(slot);
+        }
+        Clock::time_point t2 = Clock::now();
+        bool keepRunning;
+        {
+            PROFILE_SCOPE("render");
+            keepRunning = render(slot);
+        }
+        Clock::time_point t3 = Clock::now();
+
+        stats.capture.add(elapsedMs(t0, t1));
+        stats.detect.add(elapsedMs(t1, t2));
+        stats.render.add(elapsedMs(t2, t3));
+        stats.endToEnd.add(elapsedMs(t0, t3));
+        stats.framesDisplayed++;
+        if (!keepRunning) break;
+    }
+
+    stats.wallSeconds = elapsedMs(loopStart, Clock::now()) / 1000.0;
+    return stats;
+}
+
+PipelineStats runPipelinedLoop(cv::VideoCapture& cap, const DetectStage& detect, const RenderStage& render, const PipelineConfig& config) {
+    // Every slot is either free, queued, or held by exactly one stage, so this many never runs dry
+    const size_t slotCount = config.detectQueueDepth + config.renderQueueDepth + 3;
+    std::vector<FrameSlot> slots(slotCount);
+    FrameQueue freeQueue(slotCount), detectQueue(config.detectQueueDepth), renderQueue(config.renderQueueDepth);
+    for (size_t i = 0; i < slotCount; ++i) {
+        freeQueue.push(static_cast<int>(i));
+    }
+
+    PipelineStats stats;
+    StageTiming captureTiming, detectTiming;
+    std::atomic<int64_t> dropped(0);
+
+    // Return an evicted slot to the free pool and count it as dropped
+    auto recycle = [&](int evicted) {
+        if (evicted >= 0) {
+            freeQueue.push(evicted);
+            dropped++;
+        }
+    };
+
+    const Clock::time_point loopStart = Clock::now();
+
+    std::thread captureThread([&] {
+        profilerSetThreadName("capture");
+        int slotIndex;
+        for (int64_t frameIndex = 0; freeQueue.pop(slotIndex); ++frameIndex) {
+            FrameSlot& slot = slots[slotIndex];
+            Clock::time_point t0 = Clock::now();
+            {
+                PROFILE_SCOPE("capture");
+                cap >> slot.frame;
+            }
+            if (slot.frame.empty()) break;
+            slot.frameIndex = frameIndex;
+            slot.captureTime = t0;
+            captureTiming.add(elapsedMs(t0, Clock::now()));
+
+            int evicted;
+            if (!detectQueue.push(slotIndex, config.dropStaleFrames ? &evicted : nullptr)) break;
+            if (config.dropStaleFrames) recycle(evicted);
+        }
+        detectQueue.close();
+    });
+
+    std::thread detectThread([&] {
+        profilerSetThreadName("detect");
+        int slotIndex;
+        while (detectQueue.pop(slotIndex)) {
+            Clock::time_point t0 = Clock::now();
+            {
+                PROFILE_SCOPE("detect");
+                detect(slots[slotIndex]);
+            }
+            detectTiming.add(elapsedMs(t0, Clock::now()));
+
+            int evicted;
+            if (!renderQueue.push(slotIndex, config.dropStaleFrames ? &evicted : nullptr)) break;
+            if (config.dropStaleFrames) recycle(evicted);
+        }
+        renderQueue.close();
+    });
+
+    // Rendering stays on the calling thread because the display window is owned by it
+    profilerSetThreadName("render");
+    int slotIndex;
+    while (renderQueue.pop(slotIndex)) {
+        FrameSlot& slot = slots[slotIndex];
+        Clock::time_point t0 = Clock::now();
+        bool keepRunning;
+        {
+            PROFILE_SCOPE("render");
+            keepRunning = render(slot);
+        }
+        Clock::time_point t1 = Clock::now();
+        stats.render.add(elapsedMs(t0, t1));
+        stats.endToEnd.add(elapsedMs(slot.captureTime, t1));
+        stats.framesDisplayed++;
+        freeQueue.push(slotIndex);
+        if (!keepRunning) break;
+    }
+
+    freeQueue.close();
+    detectQueue.close();
+    renderQueue.close();
+    captureThread.join();
+    detectThread.join();
+
+    stats.wallSeconds = elapsedMs(loopStart, Clock::now()) / 1000.0;
+    stats.capture = captureTiming;
+    stats.detect = detectTiming;
+    stats.framesDropped = dropped.load();
+    return stats;
+}
+
+void printPipelineStats(const std::string& label, const PipelineStats& stats) {
+    double fps = stats.wallSeconds > 0.0 ? stats.framesDisplayed / stats.wallSeconds : 0.0;
+    double sumMs = stats.capture.meanMs() + stats.detect.meanMs() + stats.render.meanMs();
+    double slowestMs = std::max({ stats.capture.meanMs(), stats.detect.meanMs(), stats.render.meanMs() });
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "[" << label << "] " << stats.framesDisplayed << " frames in " << stats.wallSeconds << " s ("
+        << fps << " fps), dropped " << stats.framesDropped << std::endl;
+    std::cout << "  capture mean " << stats.capture.meanMs() << " ms (max " << stats.capture.maxMs << ")" << std::endl;
+    std::cout << "  detect  mean " << stats.detect.meanMs() << " ms (max " << stats.detect.maxMs << ")" << std::endl;
+    std::cout << "  render  mean " << stats.render.meanMs() << " ms (max " << stats.render.maxMs << ")" << std::endl;
+    std::cout << "  capture-to-display latency mean " << stats.endToEnd.meanMs() << " ms (max " << stats.endToEnd.maxMs << ")" << std::endl;
+    if (sumMs > 0.0 && slowestMs > 0.0) {
+        std::cout << "  serial bound " << 1000.0 / sumMs << " fps, pipelined bound " << 1000.0 / slowestMs << " fps" << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "FeatureDetection.h"
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+// One preallocated frame buffer that travels through the capture, detection and render stages
+struct FrameSlot {
+    cv::Mat frame;
+    std::vector<cv::Point2f> corner_set;
+    bool found = false;
+    bool poseValid = false;
+    bool cornersPredicted = false;  // Corners were projected from a feature-tracked pose, not detected
+    std::vector<cv::Point2f> trackedFeatures;  // Inlier features of a feature-tracked pose, drawn by the render stage
+    bool undistorted = false;  // Frame and corners already have lens distortion removed
+    bool hasFeatures = false;  // Features were requested for this frame
+    FeatureType featureType = FeatureType::ORB;
+    std::vector<cv::KeyPoint> features;
+    cv::Mat rvec, tvec;
+    int64_t frameIndex = 0;
+    std::chrono::steady_clock::time_point captureTime;
+};
+
+// Bounded FIFO of slot indices shared between two stages
+class FrameQueue {
+public:
+    explicit FrameQueue(size_t capacity);
+
+    // Push a slot index. If the queue is full and evicted is not null, the oldest entry is
+    // removed and returned through evicted (drop stale frames); otherwise the call blocks.
+    bool push(int slot, int* evicted = nullptr);
+
+    // Pop the oldest slot index, blocking until one is available. Returns false once closed and empty.
+    bool pop(int& slot);
+
+    void close();
+
+private:
+    std::mutex mutex;
+    std::condition_variable notEmpty, notFull;
+    std::vector<int> ring;
+    size_t head = 0;
+    size_t count = 0;
+    bool closed = false;
+};
+
+struct PipelineConfig {
+    size_t detectQueueDepth = 2;   // Frames waiting for detection
+    size_t renderQueueDepth = 2;   // Frames waiting for display
+    bool dropStaleFrames = true;   // Evict the oldest queued frame instead of blocking the producer
+};
+
+// Accumulated latency of one stage in milliseconds
+struct StageTiming {
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+    int64_t count = 0;
+
+    void add(double ms);
+    double meanMs() const { return count > 0 ? totalMs / count : 0.0; }
+};
+
+struct PipelineStats {
+    StageTiming capture, detect, render, endToEnd;
+    int64_t framesDisplayed = 0;
+    int64_t framesDropped = 0;
+    double wallSeconds = 0.0;
+};
+
+// Stage callbacks: detection fills corners and pose, render draws and displays (returns false to stop)
+using DetectStage = std::function<void(FrameSlot&)>;
+using RenderStage = std::function<bool(FrameSlot&)>;
+
+// Run capture, detection and render one after another on the calling thread
+PipelineStats runSerialLoop(cv::VideoCapture& cap, const DetectStage& detect, const RenderStage& render);
+
+// Run capture and detection on worker threads connected by bounded queues; render stays on the calling thread
+PipelineStats runPipelinedLoop(cv::VideoCapture& cap, const DetectStage& detect, const RenderStage& render, const PipelineConfig& config = PipelineConfig());
+
+// Print throughput, per-stage latency and the serial/pipelined throughput bounds
+void printPipelineStats(const std::string& label, const PipelineStats& stats);
@@ -0,0 +1,378 @@
+#include "MeshSimplification.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <queue>
+#include <tuple>
+
+namespace {
+
+struct Vec3 {
+    double x = 0.0, y = 0.0, z = 0.0;
+};
+
+inline Vec3 operator+(const Vec3& a, const Vec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+inline Vec3 operator-(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline Vec3 operator*(const Vec3& a, double s) { return { a.x * s, a.y * s, a.z * s }; }
+inline double dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 cross(const Vec3& a, const Vec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+inline double length(const Vec3& a) { return std::sqrt(dot(a, a)); }
+
+// Symmetric 4x4 error quadric of one or more planes, stored as its upper triangle
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+    // Squared distance to the plane n.x + d = 0 (n of unit length), times weight
+    static Quadric plane(const Vec3& n, double d, double weight) {
+        Quadric q;
+        q.a2 = weight * n.x * n.x; q.ab = weight * n.x * n.y; q.ac = weight * n.x * n.z; q.ad = weight * n.x * d;
+        q.b2 = weight * n.y * n.y; q.bc = weight * n.y * n.z; q.bd = weight * n.y * d;
+        q.c2 = weight * n.z * n.z; q.cd = weight * n.z * d;
+        q.d2 = weight * d * d;
+        return q;
+    }
+
+    Quadric& operator+=(const Quadric& o) {
+        a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad; b2 += o.b2; bc += o.bc; bd += o.bd; c2 += o.c2; cd += o.cd; d2 += o.d2;
+        return *this;
+    }
+
+    double error(const Vec3& v) const {
+        return a2 * v.x * v.x + 2 * ab * v.x * v.y + 2 * ac * v.x * v.z + 2 * ad * v.x +
+            b2 * v.y * v.y + 2 * bc * v.y * v.z + 2 * bd * v.y +
+            c2 * v.z * v.z + 2 * cd * v.z + d2;
+    }
+
+    // Position with the smallest error; false when the planes do not pin down a single point
+    bool minimum(Vec3& v) const {
+        double det = a2 * (b2 * c2 - bc * bc) - ab * (ab * c2 - bc * ac) + ac * (ab * bc - b2 * ac);
+        if (std::abs(det) < 1e-12) {
+            return false;
+        }
+        // Cramer's rule on the upper-left 3x3 block with right-hand side -(ad, bd, cd)
+        double rx = -ad, ry = -bd, rz = -cd;
+        v.x = (rx * (b2 * c2 - bc * bc) - ab * (ry * c2 - bc * rz) + ac * (ry * bc - b2 * rz)) / det;
+        v.y = (a2 * (ry * c2 - rz * bc) - rx * (ab * c2 - bc * ac) + ac * (ab * rz - ry * ac)) / det;
+        v.z = (a2 * (b2 * rz - bc * ry) - ab * (ab * rz - ry * ac) + rx * (ab * bc - b2 * ac)) / det;
+        return true;
+    }
+};
+
+inline Quadric operator+(Quadric a, const Quadric& b) { return a += b; }
+
+struct Collapse {
+    double cost;
+    int u, v;
+    uint32_t uStamp, vStamp;  // Versions of both vertices when the entry was made; stale entries are skipped
+    Vec3 target;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+// Mutable triangle mesh with vertex-to-face adjacency used while collapsing edges
+class Simplifier {
+public:
+    explicit Simplifier(const Mesh& mesh);
+    void run(size_t targetTriangles);
+    void output(Mesh& result) const;
+
+private:
+    Vec3 faceNormal(const std::array<int, 3>& face) const;
+    void computeQuadrics();
+    void pushCollapse(int u, int v);
+    bool collapseKeepsShape(int u, int v, const Vec3& target) const;
+    bool isManifoldCollapse(int u, int v) const;
+    void collapse(int u, int v, const Vec3& target);
+
+    std::vector<Vec3> positions;
+    std::vector<Quadric> quadrics;
+    std::vector<uint32_t> stamps;
+    std::vector<char> vertexAlive;
+    std::vector<std::array<int, 3>> faces;
+    std::vector<char> faceAlive;
+    std::vector<std::vector<int>> vertexFaces;
+    size_t aliveFaces = 0;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+};
+
+Simplifier::Simplifier(const Mesh& mesh) {
+    // Weld vertices at identical positions so faces split only by texture seams still share edges
+    std::map<std::tuple<float, float, float>, int> welded;
+    std::vector<int> remap(mesh.vertexCount());
+    for (size_t i = 0; i < mesh.vertexCount(); ++i) {
+        auto key = std::make_tuple(mesh.px[i], mesh.py[i], mesh.pz[i]);
+        auto found = welded.find(key);
+        if (found == welded.end()) {
+            found = welded.emplace(key, int(positions.size())).first;
+            positions.push_back({ mesh.px[i], mesh.py[i], mesh.pz[i] });
+        }
+        remap[i] = found->second;
+    }
+
+    // Fan-triangulate every polygon, dropping triangles that collapse onto a welded vertex
+    for (size_t f = 0; f < mesh.faceCount(); ++f) {
+        uint32_t begin = mesh.faceOffsets[f], end = mesh.faceOffsets[f + 1];
+        for (uint32_t c = begin + 1; c + 1 < end; ++c) {
+            std::array<int, 3> face = { remap[mesh.cornerVertices[begin]], remap[mesh.cornerVertices[c]], remap[mesh.cornerVertices[c + 1]] };
+            if (face[0] != face[1] && face[1] != face[2] && face[0] != face[2]) {
+                faces.push_back(face);
+            }
+        }
+    }
+
+    faceAlive.assign(faces.size(), 1);
+    aliveFaces = faces.size();
+    vertexAlive.assign(positions.size(), 1);
+    stamps.assign(positions.size(), 0);
+    vertexFaces.resize(positions.size());
+    for (size_t f = 0; f < faces.size(); ++f) {
+        for (int v : faces[f]) vertexFaces[v].push_back(int(f));
+    }
+    computeQuadrics();
+}
+
+Vec3 Simplifier::faceNormal(const std::array<int, 3>& face) const {
+    return cross(positions[face[1]] - positions[face[0]], positions[face[2]] - positions[face[0]]);
+}
+
+void Simplifier::computeQuadrics() {
+    quadrics.assign(positions.size(), Quadric());
+    std::map<std::pair<int, int>, int> edgeUse;
+    for (const auto& face : faces) {
+        Vec3 n = faceNormal(face);
+        double area2 = length(n);
+        if (area2 <= 0.0) continue;
+        n = n * (1.0 / area2);
+        // Weight each face plane by its area so large flat faces hold their shape
+        Quadric q = Quadric::plane(n, -dot(n, positions[face[0]]), area2 * 0.5);
+        for (int i = 0; i < 3; ++i) {
+            quadrics[face[i]] += q;
+            int a = face[i], b = face[(i + 1) % 3];
+            edgeUse[{ std::min(a, b), std::max(a, b) }]++;
+        }
+    }
+
+    // Border edges get a stiff plane through the edge, perpendicular to its face, so open outlines do not shrink
+    const double borderWeight = 1000.0;
+    for (const auto& face : faces) {
+        Vec3 n = faceNormal(face);
+        if (length(n) <= 0.0) continue;
+        for (int i = 0; i < 3; ++i) {
+            int a = face[i], b = face[(i + 1) % 3];
+            if (edgeUse[{ std::min(a, b), std::max(a, b) }] != 1) continue;
+            Vec3 edge = positions[b] - positions[a];
+            Vec3 side = cross(edge, n);
+            double sideLength = length(side);
+            if (sideLength <= 0.0) continue;
+            side = side * (1.0 / sideLength);
+            Quadric q = Quadric::plane(side, -dot(side, positions[a]), borderWeight * dot(edge, edge));
+            quadrics[a] += q;
+            quadrics[b] += q;
+        }
+    }
+
+    for (const auto& face : faces) {
+        for (int i = 0; i < 3; ++i) {
+            int a = face[i], b = face[(i + 1) % 3];
+            if (a < b) pushCollapse(a, b);
+            else if (edgeUse[{ b, a }] == 1) pushCollapse(b, a);  // Border edges appear in one direction only
+        }
+    }
+}
+
+void Simplifier::pushCollapse(int u, int v) {
+    Quadric q = quadrics[u] + quadrics[v];
+    Vec3 target;
+    double cost;
+    if (q.minimum(target)) {
+        cost = q.error(target);
+    }
+    else {
+        // Degenerate quadric (flat or straight region): take the best of the two ends and the midpoint
+        Vec3 candidates[3] = { positions[u], positions[v], (positions[u] + positions[v]) * 0.5 };
+        target = candidates[0];
+        cost = q.error(target);
+        for (int i = 1; i < 3; ++i) {
+            double e = q.error(candidates[i]);
+            if (e < cost) { cost = e; target = candidates[i]; }
+        }
+    }
+    heap.push({ std::max(cost, 0.0), u, v, stamps[u], stamps[v], target });
+}
+
+bool Simplifier::collapseKeepsShape(int u, int v, const Vec3& target) const {
+    // Every face that survives the collapse must keep facing roughly the same way
+    for (int w : { u, v }) {
+        for (int f : vertexFaces[w]) {
+            if (!faceAlive[f]) continue;
+            const auto& face = faces[f];
+            bool hasU = face[0] == u || face[1] == u || face[2] == u;
+            bool hasV = face[0] == v || face[1] == v || face[2] == v;
+            if (hasU && hasV) continue;  // Removed by the collapse
+            std::array<Vec3, 3> moved = { positions[face[0]], positions[face[1]], positions[face[2]] };
+            for (int i = 0; i < 3; ++i) {
+                if (face[i] == w) moved[i] = target;
+            }
+            Vec3 before = faceNormal(face);
+            Vec3 after = cross(moved[1] - moved[0], moved[2] - moved[0]);
+            double lb = length(before), la = length(after);
+            if (la <= 1e-12 * std::max(lb, 1e-12)) return false;          // Would become degenerate
+            if (lb > 0.0 && dot(before, after) < 0.2 * lb * la) return false;  // Would flip or fold
+        }
+    }
+    return true;
+}
+
+bool Simplifier::isManifoldCollapse(int u, int v) const {
+    // Link condition: the vertices adjacent to both u and v must be exactly the opposite corners of their shared faces
+    std::vector<int> neighborsU, neighborsV;
+    int sharedFaces = 0;
+    for (int f : vertexFaces[u]) {
+        if (!faceAlive[f]) continue;
+        const auto& face = faces[f];
+        bool hasV = face[0] == v || face[1] == v || face[2] == v;
+        sharedFaces += hasV ? 1 : 0;
+        for (int w : face) if (w != u) neighborsU.push_back(w);
+    }
+    for (int f : vertexFaces[v]) {
+        if (!faceAlive[f]) continue;
+        for (int w : faces[f]) if (w != v) neighborsV.push_back(w);
+    }
+    std::sort(neighborsU.begin(), neighborsU.end());
+    neighborsU.erase(std::unique(neighborsU.begin(), neighborsU.end()), neighborsU.end());
+    std::sort(neighborsV.begin(), neighborsV.end());
+    neighborsV.erase(std::unique(neighborsV.begin(), neighborsV.end()), neighborsV.end());
+    std::vector<int> common;
+    std::set_intersection(neighborsU.begin(), neighborsU.end(), neighborsV.begin(), neighborsV.end(), std::back_inserter(common));
+    return sharedFaces > 0 && int(common.size()) == sharedFaces;
+}
+
+void Simplifier::collapse(int u, int v, const Vec3& target) {
+    positions[u] = target;
+    quadrics[u] += quadrics[v];
+    vertexAlive[v] = 0;
+    stamps[u]++;
+    stamps[v]++;
+
+    for (int f : vertexFaces[v]) {
+        if (!faceAlive[f]) continue;
+        auto& face = faces[f];
+        if (face[0] == u || face[1] == u || face[2] == u) {
+            faceAlive[f] = 0;
+            --aliveFaces;
+            continue;
+        }
+        for (int& w : face) {
+            if (w == v) w = u;
+        }
+        vertexFaces[u].push_back(f);
+    }
+    vertexFaces[v].clear();
+
+    // Drop removed faces from u's list, then queue every edge around u with its new cost. Only u's and v's
+    // stamps change: the neighbors' other edges keep their quadrics and stay valid in the queue.
+    auto& around = vertexFaces[u];
+    around.erase(std::remove_if(around.begin(), around.end(), [this](int f) { return !faceAlive[f]; }), around.end());
+    std::vector<int> neighbors;
+    for (int f : around) {
+        for (int w : faces[f]) if (w != u) neighbors.push_back(w);
+    }
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    for (int w : neighbors) {
+        pushCollapse(u, w);
+    }
+}
+
+void Simplifier::run(size_t targetTriangles) {
+    while (aliveFaces > targetTriangles && !heap.empty()) {
+        Collapse c = heap.top();
+        heap.pop();
+        if (!vertexAlive[c.u] || !vertexAlive[c.v] || stamps[c.u] != c.uStamp || stamps[c.v] != c.vStamp) {
+            continue;
+        }
+        if (!isManifoldCollapse(c.u, c.v) || !collapseKeepsShape(c.u, c.v, c.target)) {
+            continue;
+        }
+        collapse(c.u, c.v, c.target);
+    }
+}
+
+void Simplifier::output(Mesh& result) const {
+    result = Mesh();
+    std::vector<int> remap(positions.size(), -1);
+    for (size_t f = 0; f < faces.size(); ++f) {
+        if (!faceAlive[f]) continue;
+        for (int v : faces[f]) {
+            if (remap[v] < 0) {
+                remap[v] = int(result.px.size());
+                result.px.push_back(float(positions[v].x));
+                result.py.push_back(float(positions[v].y));
+                result.pz.push_back(float(positions[v].z));
+            }
+        }
+    }
+
+    // Area-weighted vertex normals; each corner uses the normal of its vertex
+    std::vector<Vec3> normals(result.px.size());
+    result.faceOffsets.push_back(0);
+    for (size_t f = 0; f < faces.size(); ++f) {
+        if (!faceAlive[f]) continue;
+        Vec3 n = faceNormal(faces[f]);
+        for (int v : faces[f]) {
+            normals[remap[v]] = normals[remap[v]] + n;
+            result.cornerVertices.push_back(remap[v]);
+            result.cornerTextures.push_back(-1);
+            result.cornerNormals.push_back(remap[v]);
+        }
+        result.faceOffsets.push_back(uint32_t(result.cornerVertices.size()));
+    }
+    for (const Vec3& n : normals) {
+        double l = length(n);
+        Vec3 unit = l > 0.0 ? n * (1.0 / l) : Vec3{ 0.0, 0.0, 1.0 };
+        result.nx.push_back(float(unit.x));
+        result.ny.push_back(float(unit.y));
+        result.nz.push_back(float(unit.z));
+    }
+    buildEdgeList(result);
+}
+
+} // namespace
+
+size_t triangleCount(const Mesh& mesh) {
+    size_t count = 0;
+    for (size_t f = 0; f < mesh.faceCount(); ++f) {
+        uint32_t corners = mesh.faceOffsets[f + 1] - mesh.faceOffsets[f];
+        count += corners >= 3 ? corners - 2 : 0;
+    }
+    return count;
+}
+
+void simplifyMesh(const Mesh& mesh, size_t targetTriangles, Mesh& result) {
+    Simplifier simplifier(mesh);
+    simplifier.run(targetTriangles);
+    simplifier.output(result);
+}
+
+void buildLodChain(const Mesh& mesh, std::vector<Mesh>& levels, float ratio, size_t minTriangles, int maxLevels) {
+    levels.clear();
+    levels.push_back(mesh);
+    size_t triangles = triangleCount(mesh);
+    while (int(levels.size()) < maxLevels) {
+        size_t target = size_t(triangles * ratio);
+        if (target < minTriangles) {
+            break;
+        }
+        // Each level starts from the previous one, so the whole chain costs about twice the first step
+        Mesh next;
+        simplifyMesh(levels.back(), target, next);
+        size_t reached = triangleCount(next);
+        if (reached >= triangles) {
+            break;  // Nothing left that can be collapsed safely
+        }
+        levels.push_back(std::move(next));
+        triangles = reached;
+    }
+}
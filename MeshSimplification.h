@@ -0,0 +1,18 @@
+#pragma once
+#include "ModelLoader.h"
+#include <vector>
+#include <cstddef>
+
+// Reduce a mesh to about targetTriangles with quadric error metric edge collapses (Garland and Heckbert).
+// Polygons are fan-triangulated first and vertices at the same position are welded. Each collapse moves the
+// pair to the position with the smallest summed squared distance to the planes of their original faces.
+// Collapses that would flip a face or make the mesh non-manifold are skipped, and open borders are held in
+// place by extra planes. The result has triangle faces, area-weighted vertex normals and no texture coordinates.
+void simplifyMesh(const Mesh& mesh, size_t targetTriangles, Mesh& result);
+
+// Build progressively coarser copies of a mesh: each level keeps about ratio of the previous level's triangles.
+// levels[0] is the source mesh unchanged. Stops before a level would fall below minTriangles or at maxLevels levels.
+void buildLodChain(const Mesh& mesh, std::vector<Mesh>& levels, float ratio = 0.5f, size_t minTriangles = 64, int maxLevels = 6);
+
+// Triangles of a mesh after fan triangulation
+size_t triangleCount(const Mesh& mesh);
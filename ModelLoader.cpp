@@ -1,14 +1,520 @@
 // ModelLoader.cpp
 
 #include "ModelLoader.h"
+#include "MappedFile.h"
+#include "MeshSimplification.h"
 #include <tuple>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <filesystem>
+#include <algorithm>
 
-bool loadOBJModel(const std::string& path, std::vector<Vertex>& vertices, std::vector<TextureCoord>& textures, std::vector<Normal>& normals, std::vector<Face>& faces) {
+namespace {
+
+// Binary mesh cache layout: header, then every Mesh array in declaration order
+const char meshCacheMagic[4] = { 'A', 'R', 'M', 'C' };
+const uint32_t meshCacheVersion = 3;
+
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t sourceHash;
+    uint64_t vertexCount;
+    uint64_t normalCount;
+    uint64_t textureCount;
+    uint64_t faceCount;
+    uint64_t cornerCount;
+    uint64_t edgeCount;
+};
+
+std::string meshCachePath(const std::string& path) {
+    return path + ".meshcache";
+}
+
+// Level k of the simplified chain is cached in the same format as the full mesh
+std::string lodCachePath(const std::string& path, size_t level) {
+    return path + ".lod" + std::to_string(level) + ".meshcache";
+}
+
+int64_t fileTime(const std::string& path) {
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(path, error);
+    return error ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+}
+
+inline const char* findLineEnd(const char* p, const char* end) {
+    const void* newline = std::memchr(p, '\n', end - p);
+    return newline ? static_cast<const char*>(newline) : end;
+}
+
+inline void skipSpaces(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+}
+
+inline bool parseFloat(const char*& p, const char* end, float& value) {
+    skipSpaces(p, end);
+    if (p < end && *p == '+') ++p;  // from_chars does not accept a leading '+'
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) return false;
+    p = result.ptr;
+    return true;
+}
+
+inline bool parseInt(const char*& p, const char* end, int& value) {
+    if (p < end && *p == '+') ++p;
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) return false;
+    p = result.ptr;
+    return true;
+}
+
+// OBJ indices are 1-based and may be negative (relative to the end of the list so far). Stores the 0-based
+// index and returns false when it is 0 or does not refer to an element declared so far.
+inline bool resolveIndex(int index, size_t count, int32_t& resolved) {
+    int64_t value = index < 0 ? static_cast<int64_t>(count) + index : static_cast<int64_t>(index) - 1;
+    if (index == 0 || value < 0 || value >= static_cast<int64_t>(count)) {
+        return false;
+    }
+    resolved = static_cast<int32_t>(value);
+    return true;
+}
+
+inline bool startsWith(const char* p, const char* end, const char* prefix, size_t length) {
+    return static_cast<size_t>(end - p) > length && std::memcmp(p, prefix, length) == 0 && (p[length] == ' ' || p[length] == '\t');
+}
+
+// Number of whitespace-separated tokens left on a line
+inline size_t countTokens(const char* p, const char* end) {
+    size_t tokens = 0;
+    while (true) {
+        skipSpaces(p, end);
+        if (p >= end) return tokens;
+        tokens++;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r') ++p;
+    }
+}
+
+bool parseOBJ(const char* data, size_t size, Mesh& mesh) {
+    const char* end = data + size;
+
+    // Counting pass so no array grows while parsing
+    size_t vertexCount = 0, textureCount = 0, normalCount = 0, faceCount = 0, cornerCount = 0;
+    for (const char* p = data; p < end;) {
+        const char* lineEnd = findLineEnd(p, end);
+        skipSpaces(p, lineEnd);
+        if (startsWith(p, lineEnd, "v", 1)) vertexCount++;
+        else if (startsWith(p, lineEnd, "vt", 2)) textureCount++;
+        else if (startsWith(p, lineEnd, "vn", 2)) normalCount++;
+        else if (startsWith(p, lineEnd, "f", 1)) {
+            faceCount++;
+            cornerCount += countTokens(p + 1, lineEnd);
+        }
+        p = lineEnd + 1;
+    }
+    for (std::vector<float>* values : { &mesh.px, &mesh.py, &mesh.pz }) values->reserve(vertexCount);
+    for (std::vector<float>* values : { &mesh.nx, &mesh.ny, &mesh.nz }) values->reserve(normalCount);
+    for (std::vector<float>* values : { &mesh.tu, &mesh.tv }) values->reserve(textureCount);
+    mesh.faceOffsets.reserve(faceCount + 1);
+    mesh.cornerVertices.reserve(cornerCount);
+    mesh.cornerTextures.reserve(cornerCount);
+    mesh.cornerNormals.reserve(cornerCount);
+
+    mesh.faceOffsets.push_back(0);
+    size_t lineNumber = 0;
+    for (const char* p = data; p < end;) {
+        lineNumber++;
+        const char* lineEnd = findLineEnd(p, end);
+        skipSpaces(p, lineEnd);
+        if (startsWith(p, lineEnd, "v", 1)) {
+            p += 1;
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            parseFloat(p, lineEnd, x) && parseFloat(p, lineEnd, y) && parseFloat(p, lineEnd, z);
+            mesh.px.push_back(x);
+            mesh.py.push_back(y);
+            mesh.pz.push_back(z);
+        }
+        else if (startsWith(p, lineEnd, "vt", 2)) {
+            p += 2;
+            float u = 0.0f, v = 0.0f;
+            parseFloat(p, lineEnd, u) && parseFloat(p, lineEnd, v);
+            mesh.tu.push_back(u);
+            mesh.tv.push_back(v);
+        }
+        else if (startsWith(p, lineEnd, "vn", 2)) {
+            p += 2;
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            parseFloat(p, lineEnd, x) && parseFloat(p, lineEnd, y) && parseFloat(p, lineEnd, z);
+            mesh.nx.push_back(x);
+            mesh.ny.push_back(y);
+            mesh.nz.push_back(z);
+        }
+        else if (startsWith(p, lineEnd, "f", 1)) {
+            p += 1;
+            // Each corner is v, v/vt, v//vn or v/vt/vn
+            while (true) {
+                skipSpaces(p, lineEnd);
+                int index;
+                if (p >= lineEnd || !parseInt(p, lineEnd, index)) break;
+                int32_t vertex = -1, texture = -1, normal = -1;
+                bool valid = resolveIndex(index, mesh.px.size(), vertex);
+                if (p < lineEnd && *p == '/') {
+                    ++p;
+                    if (p < lineEnd && *p != '/' && parseInt(p, lineEnd, index)) {
+                        valid = valid && resolveIndex(index, mesh.tu.size(), texture);
+                    }
+                    if (p < lineEnd && *p == '/') {
+                        ++p;
+                        if (parseInt(p, lineEnd, index)) {
+                            valid = valid && resolveIndex(index, mesh.nx.size(), normal);
+                        }
+                    }
+                }
+                if (!valid) {
+                    // Everything downstream indexes the arrays directly, so one bad index rejects the file
+                    std::cerr << "Face index out of range on line " << lineNumber << std::endl;
+                    return false;
+                }
+                mesh.cornerVertices.push_back(vertex);
+                mesh.cornerTextures.push_back(texture);
+                mesh.cornerNormals.push_back(normal);
+                // Skip anything malformed up to the next corner
+                while (p < lineEnd && *p != ' ' && *p != '\t' && *p != '\r') ++p;
+            }
+            mesh.faceOffsets.push_back(static_cast<uint32_t>(mesh.cornerVertices.size()));
+        }
+        p = lineEnd + 1;
+    }
+    return true;
+}
+
+template <typename T>
+void writeArray(std::ofstream& out, const std::vector<T>& values) {
+    if (!values.empty()) {
+        out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+}
+
+bool writeMeshCache(const std::string& cachePath, const MeshCacheHeader& stamp, const Mesh& mesh) {
+    MeshCacheHeader header = stamp;
+    std::memcpy(header.magic, meshCacheMagic, sizeof(header.magic));
+    header.version = meshCacheVersion;
+    header.vertexCount = mesh.px.size();
+    header.normalCount = mesh.nx.size();
+    header.textureCount = mesh.tu.size();
+    header.faceCount = mesh.faceCount();
+    header.cornerCount = mesh.cornerVertices.size();
+    header.edgeCount = mesh.edgeCount();
+
+    // Write next to the final path and rename so a crash never leaves a half-written cache
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const std::vector<float>* values : { &mesh.px, &mesh.py, &mesh.pz, &mesh.nx, &mesh.ny, &mesh.nz, &mesh.tu, &mesh.tv }) {
+            writeArray(out, *values);
+        }
+        writeArray(out, mesh.faceOffsets);
+        writeArray(out, mesh.cornerVertices);
+        writeArray(out, mesh.cornerTextures);
+        writeArray(out, mesh.cornerNormals);
+        writeArray(out, mesh.edges);
+        if (!out.good()) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, cachePath, error);
+    return !error;
+}
+
+template <typename T>
+const char* readArray(const char* p, std::vector<T>& values, uint64_t count) {
+    values.resize(static_cast<size_t>(count));
+    if (count > 0) {
+        std::memcpy(values.data(), p, static_cast<size_t>(count) * sizeof(T));
+    }
+    return p + count * sizeof(T);
+}
+
+// Returns true when the cache exists, matches the source stamp, and was read completely
+bool readMeshCache(const std::string& cachePath, const MappedFile& source, int64_t sourceTime, bool& hashMatchedOnly, Mesh& mesh) {
+    hashMatchedOnly = false;
+    MappedFile cache;
+    if (!cache.open(cachePath) || cache.size() < sizeof(MeshCacheHeader)) {
+        return false;
+    }
+    MeshCacheHeader header;
+    std::memcpy(&header, cache.data(), sizeof(header));
+    if (std::memcmp(header.magic, meshCacheMagic, sizeof(header.magic)) != 0 || header.version != meshCacheVersion ||
+        header.sourceSize != source.size()) {
+        return false;
+    }
+
+    // A changed timestamp alone does not invalidate the cache if the contents are the same
+    if (header.sourceTime != sourceTime) {
+        if (header.sourceHash != hashBytes(source.data(), source.size())) {
+            return false;
+        }
+        hashMatchedOnly = true;
+    }
+
+    uint64_t expected = sizeof(MeshCacheHeader) +
+        (3 * header.vertexCount + 3 * header.normalCount + 2 * header.textureCount) * sizeof(float) +
+        (header.faceCount + 1) * sizeof(uint32_t) + 3 * header.cornerCount * sizeof(int32_t) +
+        2 * header.edgeCount * sizeof(uint32_t);
+    if (expected != cache.size()) {
+        return false;
+    }
+
+    const char* p = cache.data() + sizeof(MeshCacheHeader);
+    for (std::vector<float>* values : { &mesh.px, &mesh.py, &mesh.pz }) p = readArray(p, *values, header.vertexCount);
+    for (std::vector<float>* values : { &mesh.nx, &mesh.ny, &mesh.nz }) p = readArray(p, *values, header.normalCount);
+    for (std::vector<float>* values : { &mesh.tu, &mesh.tv }) p = readArray(p, *values, header.textureCount);
+    p = readArray(p, mesh.faceOffsets, header.faceCount + 1);
+    p = readArray(p, mesh.cornerVertices, header.cornerCount);
+    p = readArray(p, mesh.cornerTextures, header.cornerCount);
+    p = readArray(p, mesh.cornerNormals, header.cornerCount);
+    readArray(p, mesh.edges, 2 * header.edgeCount);
+    return true;
+}
+
+template <typename T>
+size_t vectorBytes(const std::vector<T>& values) {
+    return values.capacity() * sizeof(T);
+}
+
+} // namespace
+
+size_t Mesh::memoryBytes() const {
+    return vectorBytes(px) + vectorBytes(py) + vectorBytes(pz) + vectorBytes(nx) + vectorBytes(ny) + vectorBytes(nz) +
+        vectorBytes(tu) + vectorBytes(tv) + vectorBytes(faceOffsets) + vectorBytes(cornerVertices) +
+        vectorBytes(cornerTextures) + vectorBytes(cornerNormals) + vectorBytes(edges);
+}
+
+void buildEdgeList(Mesh& mesh) {
+    // Pack each edge as one 64-bit key so sorting brings duplicates together
+    std::vector<uint64_t> keys;
+    keys.reserve(mesh.cornerVertices.size());
+    for (size_t f = 0; f < mesh.faceCount(); ++f) {
+        uint32_t begin = mesh.faceOffsets[f], end = mesh.faceOffsets[f + 1];
+        for (uint32_t c = begin; c < end; ++c) {
+            uint32_t a = static_cast<uint32_t>(mesh.cornerVertices[c]);
+            uint32_t b = static_cast<uint32_t>(mesh.cornerVertices[c + 1 < end ? c + 1 : begin]);
+            if (a == b) continue;
+            if (a > b) std::swap(a, b);
+            keys.push_back((static_cast<uint64_t>(a) << 32) | b);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    mesh.edges.resize(keys.size() * 2);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        mesh.edges[2 * i] = static_cast<uint32_t>(keys[i] >> 32);
+        mesh.edges[2 * i + 1] = static_cast<uint32_t>(keys[i]);
+    }
+}
+
+void triangulateMesh(Mesh& mesh) {
+    size_t triangleCount = 0;
+    for (size_t f = 0; f < mesh.faceCount(); ++f) {
+        uint32_t corners = mesh.faceOffsets[f + 1] - mesh.faceOffsets[f];
+        triangleCount += corners >= 3 ? corners - 2 : 0;
+    }
+    if (triangleCount * 3 == mesh.cornerVertices.size()) {
+        return;  // Already all triangles
+    }
+
+    std::vector<uint32_t> offsets;
+    std::vector<int32_t> vertices, textures, normals;
+    offsets.reserve(triangleCount + 1);
+    vertices.reserve(triangleCount * 3);
+    textures.reserve(triangleCount * 3);
+    normals.reserve(triangleCount * 3);
+    offsets.push_back(0);
+    for (size_t f = 0; f < mesh.faceCount(); ++f) {
+        uint32_t begin = mesh.faceOffsets[f], end = mesh.faceOffsets[f + 1];
+        // Fan around the first corner
+        for (uint32_t c = begin + 1; c + 1 < end; ++c) {
+            for (uint32_t corner : { begin, c, c + 1 }) {
+                vertices.push_back(mesh.cornerVertices[corner]);
+                textures.push_back(mesh.cornerTextures[corner]);
+                normals.push_back(mesh.cornerNormals[corner]);
+            }
+            offsets.push_back(static_cast<uint32_t>(vertices.size()));
+        }
+    }
+    mesh.faceOffsets.swap(offsets);
+    mesh.cornerVertices.swap(vertices);
+    mesh.cornerTextures.swap(textures);
+    mesh.cornerNormals.swap(normals);
+}
+
+bool loadOBJMesh(const std::string& path, Mesh& mesh, bool triangulate, bool useCache) {
+    mesh = Mesh();
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Failed to open the file: " << path << std::endl;
+        return false;
+    }
+
+    int64_t sourceTime = fileTime(path);
+    std::string cachePath = meshCachePath(path);
+    bool loaded = false;
+    if (useCache) {
+        bool hashMatchedOnly = false;
+        loaded = readMeshCache(cachePath, file, sourceTime, hashMatchedOnly, mesh);
+        if (loaded && hashMatchedOnly) {
+            // Refresh the stamp so later loads skip hashing again
+            MeshCacheHeader stamp{};
+            stamp.sourceSize = file.size();
+            stamp.sourceTime = sourceTime;
+            stamp.sourceHash = hashBytes(file.data(), file.size());
+            writeMeshCache(cachePath, stamp, mesh);
+        }
+        if (!loaded) {
+            mesh = Mesh();
+        }
+    }
+
+    if (!loaded) {
+        if (!parseOBJ(file.data(), file.size(), mesh)) {
+            std::cerr << "Failed to parse the file: " << path << std::endl;
+            return false;
+        }
+        buildEdgeList(mesh);
+
+        if (useCache) {
+            MeshCacheHeader stamp{};
+            stamp.sourceSize = file.size();
+            stamp.sourceTime = sourceTime;
+            stamp.sourceHash = hashBytes(file.data(), file.size());
+            if (!writeMeshCache(cachePath, stamp, mesh)) {
+                std::cerr << "Could not write the mesh cache: " << cachePath << std::endl;
+            }
+        }
+    }
+
+    if (triangulate) {
+        triangulateMesh(mesh);
+    }
+    return true;
+}
+
+bool loadOBJMeshLods(const std::string& path, std::vector<Mesh>& levels, bool useCache) {
+    levels.clear();
+    Mesh full;
+    if (!loadOBJMesh(path, full, false, useCache)) {
+        return false;
+    }
+
+    MappedFile file;
+    bool haveSource = useCache && file.open(path);
+    int64_t sourceTime = fileTime(path);
+    MeshCacheHeader stamp{};
+    if (haveSource) {
+        stamp.sourceSize = file.size();
+        stamp.sourceTime = sourceTime;
+    }
+
+    // Cached levels are read until the empty level that marks the end of the chain
+    if (haveSource) {
+        levels.push_back(full);
+        for (size_t level = 1;; ++level) {
+            Mesh mesh;
+            bool hashMatchedOnly = false;
+            if (!readMeshCache(lodCachePath(path, level), file, sourceTime, hashMatchedOnly, mesh)) {
+                break;
+            }
+            if (hashMatchedOnly) {
+                stamp.sourceHash = hashBytes(file.data(), file.size());
+                writeMeshCache(lodCachePath(path, level), stamp, mesh);
+            }
+            if (mesh.faceCount() == 0) {
+                return true;
+            }
+            levels.push_back(std::move(mesh));
+        }
+        levels.clear();
+    }
+
+    buildLodChain(full, levels);
+    if (haveSource) {
+        stamp.sourceHash = hashBytes(file.data(), file.size());
+        Mesh endMarker;
+        endMarker.faceOffsets.push_back(0);
+        for (size_t level = 1; level <= levels.size(); ++level) {
+            const Mesh& mesh = level < levels.size() ? levels[level] : endMarker;
+            if (!writeMeshCache(lodCachePath(path, level), stamp, mesh)) {
+                std::cerr << "Could not write the LOD cache: " << lodCachePath(path, level) << std::endl;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool loadOBJModel(const std::string& path, std::vector<Vertex>& vertices, std::vector<TextureCoord>& textures, std::vector<Normal>& normals, std::vector<Face>& faces, bool useCache) {
+    Mesh mesh;
+    if (!loadOBJMesh(path, mesh, false, useCache)) {
+        return false;
+    }
+
+    // Expand the flat mesh into the per-face layout with 1-based indices
+    vertices.reserve(vertices.size() + mesh.vertexCount());
+    for (size_t i = 0; i < mesh.vertexCount(); ++i) {
+        vertices.push_back({ mesh.px[i], mesh.py[i], mesh.pz[i] });
+    }
+    textures.reserve(textures.size() + mesh.tu.size());
+    for (size_t i = 0; i < mesh.tu.size(); ++i) {
+        textures.push_back({ mesh.tu[i], mesh.tv[i] });
+    }
+    normals.reserve(normals.size() + mesh.nx.size());
+    for (size_t i = 0; i < mesh.nx.size(); ++i) {
+        normals.push_back({ mesh.nx[i], mesh.ny[i], mesh.nz[i] });
+    }
+    faces.reserve(faces.size() + mesh.faceCount());
+    for (size_t f = 0; f < mesh.faceCount(); ++f) {
+        faces.emplace_back();
+        Face& face = faces.back();
+        uint32_t begin = mesh.faceOffsets[f], end = mesh.faceOffsets[f + 1];
+        face.vertexIndices.reserve(end - begin);
+        for (uint32_t c = begin; c < end; ++c) {
+            face.vertexIndices.push_back(mesh.cornerVertices[c] + 1);
+            if (mesh.cornerTextures[c] >= 0) face.textureIndices.push_back(mesh.cornerTextures[c] + 1);
+            if (mesh.cornerNormals[c] >= 0) face.normalIndices.push_back(mesh.cornerNormals[c] + 1);
+        }
+    }
+    return true;
+}
+
+size_t legacyModelBytes(const std::vector<Vertex>& vertices, const std::vector<TextureCoord>& textures,
+    const std::vector<Normal>& normals, const std::vector<Face>& faces) {
+    // Each non-empty vector is its own heap block; count a typical 16-byte allocator header for each
+    const size_t blockOverhead = 16;
+    size_t bytes = vectorBytes(vertices) + vectorBytes(textures) + vectorBytes(normals) + vectorBytes(faces);
+    for (const Face& face : faces) {
+        for (const std::vector<int>* indices : { &face.vertexIndices, &face.textureIndices, &face.normalIndices }) {
+            if (indices->capacity() > 0) {
+                bytes += vectorBytes(*indices) + blockOverhead;
+            }
+        }
+    }
+    return bytes;
+}
+
+bool loadOBJModelReference(const std::string& path, std::vector<Vertex>& vertices, std::vector<TextureCoord>& textures, std::vector<Normal>& normals, std::vector<Face>& faces) {
     std::ifstream file(path);
     if (!file.is_open()) {
         std::cerr << "Failed to open the file: " << path << std::endl;
@@ -43,10 +549,10 @@ bool loadOBJModel(const std::string& path, std::vector<Vertex>& vertices, std::v
                 std::string index;
                 std::getline(viss, index, '/');
                 f.vertexIndices.push_back(std::stoi(index));
-                if (std::getline(viss, index, '/')) {
+                if (std::getline(viss, index, '/') && !index.empty()) {
                     f.textureIndices.push_back(std::stoi(index));
                 }
-                if (std::getline(viss, index, '/')) {
+                if (std::getline(viss, index, '/') && !index.empty()) {
                     f.normalIndices.push_back(std::stoi(index));
                 }
             }
@@ -5,6 +5,8 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <cstddef>
 
 struct Vertex {
     float x, y, z;
@@ -24,7 +26,53 @@ struct Face {
     std::vector<int> normalIndices;
 };
 
+// Flat mesh: coordinates as separate x/y/z arrays and faces in compressed sparse row form.
+// Face i uses corners faceOffsets[i] .. faceOffsets[i + 1] - 1; all indices are 0-based.
+struct Mesh {
+    std::vector<float> px, py, pz;           // Vertex positions
+    std::vector<float> nx, ny, nz;           // Normals
+    std::vector<float> tu, tv;               // Texture coordinates
+    std::vector<uint32_t> faceOffsets;       // faceCount() + 1 entries
+    std::vector<int32_t> cornerVertices;     // Vertex index of each face corner
+    std::vector<int32_t> cornerTextures;     // Texture index of each corner, -1 when missing
+    std::vector<int32_t> cornerNormals;      // Normal index of each corner, -1 when missing
+    std::vector<uint32_t> edges;             // Unique polygon edges as (a, b) pairs with a < b
+
+    size_t vertexCount() const { return px.size(); }
+    size_t faceCount() const { return faceOffsets.empty() ? 0 : faceOffsets.size() - 1; }
+    size_t edgeCount() const { return edges.size() / 2; }
+    size_t memoryBytes() const;
+};
+
+// Load an OBJ file as a flat mesh, optionally split into triangles. Uses the same binary cache as loadOBJModel.
+bool loadOBJMesh(const std::string& path, Mesh& mesh, bool triangulate = false, bool useCache = true);
+
+// Load an OBJ file as a chain of levels of detail: levels[0] is the full mesh and each further level keeps about
+// half the triangles of the one before (see buildLodChain). The simplified levels are generated once and cached
+// next to the OBJ (<path>.lod<k>.meshcache) until the OBJ changes.
+bool loadOBJMeshLods(const std::string& path, std::vector<Mesh>& levels, bool useCache = true);
+
+// Fan-triangulate every polygon in place. The edge list keeps the original polygon outlines.
+void triangulateMesh(Mesh& mesh);
+
+// Rebuild the deduplicated edge list from the faces
+void buildEdgeList(Mesh& mesh);
+
+// Load an OBJ model. The file is parsed from a memory mapping, and the result is stored in a binary
+// cache next to it (<path>.meshcache) that is reused until the OBJ's size, timestamp or contents change.
 bool loadOBJModel(const std::string& path,
+    std::vector<Vertex>& vertices,
+    std::vector<TextureCoord>& textures,
+    std::vector<Normal>& normals,
+    std::vector<Face>& faces,
+    bool useCache = true);
+
+// Heap bytes used by a model stored as per-face vectors, for comparison with Mesh::memoryBytes
+size_t legacyModelBytes(const std::vector<Vertex>& vertices, const std::vector<TextureCoord>& textures,
+    const std::vector<Normal>& normals, const std::vector<Face>& faces);
+
+// Original line-by-line stream parser, kept as the reference for the load-time benchmark
+bool loadOBJModelReference(const std::string& path,
     std::vector<Vertex>& vertices,
     std::vector<TextureCoord>& textures,
     std::vector<Normal>& normals,
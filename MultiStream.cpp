@@ -0,0 +1,301 @@
+#include "MultiStream.h"
+#include "WorkStealingPool.h"
+#include "ChessboardDetection.h"
+#include "PoseEstimator.h"
+#include "VertexProjector.h"
+#include "CalibrationFile.h"
+#include "ModelLoader.h"
+#include "Profiler.h"
+#include "Timing.h"
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Everything one stream owns; the model mesh is the only state shared between streams
+struct StreamContext {
+    explicit StreamContext(const cv::Size& patternSize) : tracker(patternSize), poseEstimator(patternSize) {}
+
+    std::string name;
+    cv::VideoCapture cap;
+    cv::Mat cameraMatrix, distCoeffs;
+    ChessboardTracker tracker;
+    PoseEstimator poseEstimator;
+    VertexProjector projector;              // Reads the shared mesh's positions in place
+    std::vector<cv::Point2f> predictedCorners, axesImagePoints;
+    FrameSlot slot;                         // Only one frame per stream is in flight, so one slot is enough
+    StreamStats stats;
+    Clock::time_point firstCapture;
+
+    std::mutex displayMutex;                // Guards displayFrame between the render task and the window loop
+    cv::Mat displayFrame;
+    bool displayFresh = false;
+    std::atomic<bool> finished{false};
+};
+
+bool isCameraIndex(const std::string& input) {
+    return !input.empty() && std::all_of(input.begin(), input.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+// Open a camera index or a video file
+bool openStream(const std::string& input, cv::VideoCapture& cap) {
+    return isCameraIndex(input) ? cap.open(std::atoi(input.c_str())) : cap.open(input);
+}
+
+// Shared state of one multi-stream run
+class MultiStreamRunner {
+public:
+    MultiStreamRunner(const MultiStreamOptions& options, const Mesh* model, const cv::Size& patternSize)
+        : options(options), model(model), patternSize(patternSize), pool(options.threads) {
+        axesPoints = { cv::Point3f(0, 0, 0), cv::Point3f(3, 0, 0), cv::Point3f(0, 3, 0), cv::Point3f(0, 0, -3) };
+    }
+
+    bool addStream(const StreamSource& source);
+    void run();
+    std::vector<StreamStats> stats() const;
+    double wallSeconds() const { return wallTime; }
+    PoolStats poolStats() const { return pool.stats(); }
+    int threadCount() const { return pool.size(); }
+
+private:
+    void detectFrame(StreamContext& stream);
+    void renderFrame(StreamContext& stream);
+    void finishStream(StreamContext& stream);
+
+    const MultiStreamOptions& options;
+    const Mesh* model;
+    cv::Size patternSize;
+    std::vector<cv::Point3f> axesPoints;
+    std::vector<std::unique_ptr<StreamContext>> streams;
+    std::atomic<bool> stopRequested{false};
+    std::atomic<int> finishedCount{0};
+    double wallTime = 0.0;
+    WorkStealingPool pool;  // Declared last so its workers stop before the streams they use are destroyed
+};
+
+bool MultiStreamRunner::addStream(const StreamSource& source) {
+    CalibrationData calibration;
+    if (!loadCalibration(source.calibrationPath, calibration)) {
+        std::cerr << "Error: could not read calibration " << source.calibrationPath << " for stream " << source.input << std::endl;
+        return false;
+    }
+    auto stream = std::make_unique<StreamContext>(patternSize);
+    stream->tracker.backend = options.detector;
+    if (!openStream(source.input, stream->cap)) {
+        std::cerr << "Error: could not open stream " << source.input << std::endl;
+        return false;
+    }
+    stream->name = "Stream " + std::to_string(streams.size()) + " (" + source.input + ")";
+    stream->stats.name = stream->name;
+    stream->cameraMatrix = calibration.cameraMatrix;
+    stream->distCoeffs = calibration.distCoeffs;
+    if (model) {
+        stream->projector.shareVertices(*model);
+    }
+    streams.push_back(std::move(stream));
+    return true;
+}
+
+void MultiStreamRunner::detectFrame(StreamContext& stream) {
+    FrameSlot& slot = stream.slot;
+    if (stopRequested.load() || (options.maxFrames > 0 && stream.stats.frames >= options.maxFrames)) {
+        finishStream(stream);
+        return;
+    }
+
+    Clock::time_point t0 = Clock::now();
+    {
+        PROFILE_SCOPE("capture");
+        stream.cap >> slot.frame;
+    }
+    if (slot.frame.empty()) {
+        finishStream(stream);
+        return;
+    }
+    if (stream.stats.frames == 0) {
+        stream.firstCapture = t0;
+    }
+    slot.captureTime = t0;
+    slot.frameIndex = stream.stats.frames;
+
+    {
+        PROFILE_SCOPE("detect");
+        bool predicted = stream.poseEstimator.predictCorners(slot.captureTime, stream.cameraMatrix, stream.distCoeffs, stream.predictedCorners);
+        slot.found = stream.tracker.track(slot.frame, slot.corner_set, predicted ? &stream.predictedCorners : nullptr);
+        slot.poseValid = slot.found && stream.poseEstimator.estimate(slot.corner_set, stream.cameraMatrix, stream.distCoeffs, slot.captureTime, slot.rvec, slot.tvec);
+    }
+    stream.stats.detect.add(elapsedMs(t0, Clock::now()));
+
+    // The render step stays on this worker's deque, where the frame is still in cache, unless an idle worker steals it
+    pool.submit([this, &stream] { renderFrame(stream); });
+}
+
+void MultiStreamRunner::renderFrame(StreamContext& stream) {
+    FrameSlot& slot = stream.slot;
+    Clock::time_point t0 = Clock::now();
+    {
+        PROFILE_SCOPE("render");
+        if (options.display && slot.found) {
+            drawBoardCorners(slot.frame, patternSize, slot.corner_set);
+        }
+        if (slot.poseValid) {
+            cv::projectPoints(axesPoints, slot.rvec, slot.tvec, stream.cameraMatrix, stream.distCoeffs, stream.axesImagePoints);
+            cv::line(slot.frame, stream.axesImagePoints[0], stream.axesImagePoints[1], cv::Scalar(0, 0, 255), 3);
+            cv::line(slot.frame, stream.axesImagePoints[0], stream.axesImagePoints[2], cv::Scalar(0, 255, 0), 3);
+            cv::line(slot.frame, stream.axesImagePoints[0], stream.axesImagePoints[3], cv::Scalar(255, 0, 0), 3);
+
+            if (model) {
+                const std::vector<cv::Point2f>& modelImagePoints = stream.projector.project(slot.rvec, slot.tvec, stream.cameraMatrix, stream.distCoeffs);
+                for (size_t i = 0; i < model->edges.size(); i += 2) {
+                    cv::line(slot.frame, modelImagePoints[model->edges[i]], modelImagePoints[model->edges[i + 1]], cv::Scalar(255, 0, 0), 1);
+                }
+            }
+        }
+        double seconds = elapsedMs(stream.firstCapture, t0) / 1000.0;
+        cv::putText(slot.frame, cv::format("%.1f fps", seconds > 0.0 ? stream.stats.frames / seconds : 0.0),
+            cv::Point(10, 25), cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 255), 2);
+    }
+
+    if (options.display) {
+        // Swap instead of copying; the capture reuses the previous display buffer for the next frame
+        std::lock_guard<std::mutex> lock(stream.displayMutex);
+        cv::swap(stream.displayFrame, slot.frame);
+        stream.displayFresh = true;
+    }
+
+    Clock::time_point t1 = Clock::now();
+    stream.stats.render.add(elapsedMs(t0, t1));
+    stream.stats.endToEnd.add(elapsedMs(slot.captureTime, t1));
+    stream.stats.frames++;
+    stream.stats.boardFrames += slot.poseValid ? 1 : 0;
+    stream.stats.seconds = elapsedMs(stream.firstCapture, t1) / 1000.0;
+
+    // The next frame queues behind the other streams' waiting frames, so the streams take turns on the pool
+    pool.submitShared([this, &stream] { detectFrame(stream); });
+}
+
+void MultiStreamRunner::finishStream(StreamContext& stream) {
+    stream.finished = true;
+    finishedCount++;
+}
+
+void MultiStreamRunner::run() {
+    Clock::time_point start = Clock::now();
+    for (auto& stream : streams) {
+        pool.submitShared([this, s = stream.get()] { detectFrame(*s); });
+    }
+
+    // Windows belong to this thread; the pool only hands finished frames over
+    while (finishedCount.load() < int(streams.size())) {
+        profilerTick("profile_summary.csv", 5.0);
+        if (!options.display) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        for (auto& stream : streams) {
+            std::lock_guard<std::mutex> lock(stream->displayMutex);
+            if (stream->displayFresh) {
+                PROFILE_SCOPE("imshow");
+                cv::imshow(stream->name, stream->displayFrame);
+                stream->displayFresh = false;
+            }
+        }
+        if (cv::waitKey(1) == 'q') {
+            stopRequested = true;
+        }
+    }
+    pool.waitIdle();
+    wallTime = elapsedMs(start, Clock::now()) / 1000.0;
+
+    for (auto& stream : streams) {
+        stream->cap.release();
+    }
+    if (options.display) {
+        cv::destroyAllWindows();
+    }
+}
+
+std::vector<StreamStats> MultiStreamRunner::stats() const {
+    std::vector<StreamStats> result;
+    for (const auto& stream : streams) {
+        result.push_back(stream->stats);
+    }
+    return result;
+}
+
+} // namespace
+
+bool runMultiStream(const MultiStreamOptions& options) {
+    const cv::Size patternSize(9, 6);
+
+    // Without a window nothing can press 'q', and a camera never runs out of frames
+    if (!options.display && options.maxFrames <= 0) {
+        for (const StreamSource& source : options.streams) {
+            if (isCameraIndex(source.input)) {
+                std::cerr << "Error: camera " << source.input << " would never stop without a window; use --frames <n> with --headless." << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // One read-only copy of the model serves every stream
+    std::unique_ptr<Mesh> model;
+    if (!options.modelPath.empty()) {
+        model = std::make_unique<Mesh>();
+        if (!loadOBJMesh(options.modelPath, *model)) {
+            std::cerr << "Failed to load the model." << std::endl;
+            return false;
+        }
+    }
+
+    MultiStreamRunner runner(options, model.get(), patternSize);
+    int opened = 0;
+    for (const StreamSource& source : options.streams) {
+        opened += runner.addStream(source) ? 1 : 0;
+    }
+    if (opened == 0) {
+        std::cerr << "Error: no stream could be opened." << std::endl;
+        return false;
+    }
+
+    std::cout << "Running " << opened << " streams on " << runner.threadCount() << " pool threads";
+    if (model) {
+        std::cout << " with one shared model (" << model->memoryBytes() / 1024.0 << " KB, "
+            << (opened - 1) * model->memoryBytes() / 1024.0 << " KB less than one copy per stream)";
+    }
+    std::cout << ". Press 'q' in a window to stop." << std::endl;
+
+    runner.run();
+    printStreamStats(runner.stats(), runner.wallSeconds());
+
+    PoolStats pool = runner.poolStats();
+    std::cout << "Pool: " << pool.tasksRun << " tasks, " << pool.localTasks << " from the worker's own deque, "
+        << pool.sharedTasks << " from the shared queue, " << pool.steals << " stolen" << std::endl;
+    return true;
+}
+
+void printStreamStats(const std::vector<StreamStats>& stats, double wallSeconds) {
+    int64_t totalFrames = 0;
+    std::cout << std::fixed << std::setprecision(2);
+    for (const StreamStats& stream : stats) {
+        totalFrames += stream.frames;
+        std::cout << stream.name << ": " << stream.frames << " frames, " << stream.fps() << " fps, board in "
+            << (stream.frames > 0 ? 100.0 * stream.boardFrames / stream.frames : 0.0) << "% of frames" << std::endl;
+        std::cout << "  detect mean " << stream.detect.meanMs() << " ms (max " << stream.detect.maxMs << "), render mean "
+            << stream.render.meanMs() << " ms (max " << stream.render.maxMs << "), capture to display mean "
+            << stream.endToEnd.meanMs() << " ms" << std::endl;
+    }
+    if (wallSeconds > 0.0) {
+        std::cout << "Aggregate: " << totalFrames << " frames in " << wallSeconds << " s ("
+            << totalFrames / wallSeconds << " fps)" << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
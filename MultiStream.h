@@ -0,0 +1,39 @@
+#pragma once
+#include "FramePipeline.h"
+#include "ChessboardDetection.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// One input of the multi-stream mode: a camera index ("0", "1", ...) or a video file, and its calibration file
+struct StreamSource {
+    std::string input;
+    std::string calibrationPath;
+};
+
+struct MultiStreamOptions {
+    std::vector<StreamSource> streams;
+    std::string modelPath;          // OBJ drawn on every stream's board; empty draws only the axes
+    int threads = 0;                // Pool size, 0 for one thread per hardware thread
+    bool display = true;            // One window per stream; otherwise run headless until the inputs end
+    int64_t maxFrames = 0;          // Frames per stream, 0 until the input ends or 'q' is pressed; required for headless cameras
+    BoardDetectorBackend detector = BoardDetectorBackend::Classic;  // Used by every stream's tracker
+};
+
+struct StreamStats {
+    std::string name;
+    int64_t frames = 0;
+    int64_t boardFrames = 0;        // Frames with a board pose
+    StageTiming detect, render, endToEnd;
+    double seconds = 0.0;           // First capture to last finished frame
+
+    double fps() const { return seconds > 0.0 ? frames / seconds : 0.0; }
+};
+
+// Run every stream's capture, chessboard detection, pose and render work on one shared work-stealing pool.
+// The model is loaded once and shared read-only; each stream keeps its own calibration, tracker and pose filter.
+// Returns false if no stream could be opened, or if a camera would run headless without a frame limit.
+bool runMultiStream(const MultiStreamOptions& options);
+
+// Print per-stream frame rates and latencies and the aggregate throughput
+void printStreamStats(const std::vector<StreamStats>& stats, double wallSeconds);
@@ -0,0 +1,296 @@
+#include "PoseEstimator.h"
+#include "Profiler.h"
+#include "CameraCalibration.h"
+#include "Timing.h"
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+cv::Matx33d rotationMatrix(const cv::Vec3d& rvec) {
+    cv::Matx33d R;
+    cv::Rodrigues(rvec, R);
+    return R;
+}
+
+cv::Vec3d rotationVector(const cv::Matx33d& R) {
+    cv::Vec3d rvec;
+    cv::Rodrigues(R, rvec);
+    return rvec;
+}
+
+cv::Vec3d readVec3d(const cv::Mat& m) {
+    cv::Mat values;
+    m.reshape(1, 3).convertTo(values, CV_64F);
+    return cv::Vec3d(values.at<double>(0), values.at<double>(1), values.at<double>(2));
+}
+
+void writeVec3d(const cv::Vec3d& v, cv::Mat& m) {
+    m.create(3, 1, CV_64F);
+    for (int i = 0; i < 3; ++i) {
+        m.at<double>(i) = v[i];
+    }
+}
+
+// Sum of squared re-projection errors; fills the 6 pose columns of the Jacobian when J is given
+double reprojectionError(const std::vector<cv::Vec3f>& objectPoints, const std::vector<cv::Point2f>& imagePoints,
+    const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, const cv::Vec3d& rvec, const cv::Vec3d& tvec,
+    std::vector<cv::Point2f>& projected, cv::Mat* J) {
+    if (J) {
+        cv::projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoeffs, projected, *J);
+    }
+    else {
+        cv::projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoeffs, projected);
+    }
+    double sum = 0.0;
+    for (size_t i = 0; i < projected.size(); ++i) {
+        cv::Point2f d = projected[i] - imagePoints[i];
+        sum += double(d.x) * d.x + double(d.y) * d.y;
+    }
+    return sum;
+}
+
+} // namespace
+
+bool PosePredictor::predict(TimePoint t, cv::Vec3d& rvec, cv::Vec3d& tvec) const {
+    if (!hasState) {
+        return false;
+    }
+    double dt = seconds(lastTime, t);
+    if (dt > maxGapSeconds) {
+        return false;
+    }
+    rvec = rotationVector(rotationMatrix(angularVelocity * dt) * rotation);
+    tvec = translation + linearVelocity * dt;
+    return true;
+}
+
+void PosePredictor::update(TimePoint t, const cv::Vec3d& rvec, const cv::Vec3d& tvec, cv::Vec3d& smoothedRvec, cv::Vec3d& smoothedTvec) {
+    double dt = hasState ? seconds(lastTime, t) : 0.0;
+    if (!hasState || dt <= 0.0 || dt > maxGapSeconds) {
+        // Start over from the measurement with no motion
+        rotation = rotationMatrix(rvec);
+        translation = tvec;
+        angularVelocity = cv::Vec3d();
+        linearVelocity = cv::Vec3d();
+    }
+    else {
+        cv::Matx33d predictedRotation = rotationMatrix(angularVelocity * dt) * rotation;
+        cv::Vec3d predictedTranslation = translation + linearVelocity * dt;
+
+        // Residual rotation that takes the prediction onto the measurement
+        cv::Vec3d rotationResidual = rotationVector(rotationMatrix(rvec) * predictedRotation.t());
+        cv::Vec3d translationResidual = tvec - predictedTranslation;
+
+        rotation = rotationMatrix(rotationResidual * alpha) * predictedRotation;
+        translation = predictedTranslation + translationResidual * alpha;
+        angularVelocity += rotationResidual * (beta / dt);
+        linearVelocity += translationResidual * (beta / dt);
+    }
+    lastTime = t;
+    hasState = true;
+    smoothedRvec = rotationVector(rotation);
+    smoothedTvec = translation;
+}
+
+int refinePose(const std::vector<cv::Vec3f>& objectPoints, const std::vector<cv::Point2f>& imagePoints,
+    const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Vec3d& rvec, cv::Vec3d& tvec, int maxIterations, double* rms,
+    PoseScratch* scratch) {
+    PoseScratch local;
+    std::vector<cv::Point2f>& projected = scratch ? scratch->projected : local.projected;
+    cv::Mat& J = scratch ? scratch->jacobian : local.jacobian;
+    double error = reprojectionError(objectPoints, imagePoints, cameraMatrix, distCoeffs, rvec, tvec, projected, &J);
+    double lambda = 1e-3;
+    int iterations = 0;
+
+    while (iterations < maxIterations) {
+        iterations++;
+
+        // Normal equations over the 6 pose parameters (the first 6 Jacobian columns)
+        cv::Matx66d JtJ;
+        cv::Matx61d Jtr;
+        for (int row = 0; row < J.rows; ++row) {
+            const double* j = J.ptr<double>(row);
+            const cv::Point2f d = projected[row / 2] - imagePoints[row / 2];
+            double residual = (row % 2 == 0) ? d.x : d.y;
+            for (int a = 0; a < 6; ++a) {
+                Jtr(a) += j[a] * residual;
+                for (int b = a; b < 6; ++b) {
+                    JtJ(a, b) += j[a] * j[b];
+                }
+            }
+        }
+        for (int a = 0; a < 6; ++a) {
+            for (int b = 0; b < a; ++b) {
+                JtJ(a, b) = JtJ(b, a);
+            }
+        }
+
+        // Damp until a step lowers the error; a huge damping means we are at the minimum
+        bool improved = false;
+        cv::Matx61d step;
+        while (lambda < 1e7) {
+            cv::Matx66d A = JtJ;
+            for (int a = 0; a < 6; ++a) {
+                A(a, a) *= 1.0 + lambda;
+            }
+            if (!cv::solve(A, -Jtr, step, cv::DECOMP_CHOLESKY)) {
+                lambda *= 10.0;
+                continue;
+            }
+            cv::Vec3d newRvec = rvec + cv::Vec3d(step(0), step(1), step(2));
+            cv::Vec3d newTvec = tvec + cv::Vec3d(step(3), step(4), step(5));
+            double newError = reprojectionError(objectPoints, imagePoints, cameraMatrix, distCoeffs, newRvec, newTvec, projected, nullptr);
+            if (newError < error) {
+                double previousError = error;
+                rvec = newRvec;
+                tvec = newTvec;
+                error = newError;
+                lambda = std::max(lambda * 0.1, 1e-9);
+                improved = previousError - newError > 1e-10 * previousError;
+                break;
+            }
+            lambda *= 10.0;
+        }
+        if (!improved || cv::norm(step) < 1e-8) {
+            break;
+        }
+        error = reprojectionError(objectPoints, imagePoints, cameraMatrix, distCoeffs, rvec, tvec, projected, &J);
+    }
+
+    if (rms) {
+        *rms = imagePoints.empty() ? 0.0 : std::sqrt(error / imagePoints.size());
+    }
+    return iterations;
+}
+
+bool planarPoseFromHomography(const std::vector<cv::Vec3f>& objectPoints, const std::vector<cv::Point2f>& imagePoints,
+    const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Vec3d& rvec, cv::Vec3d& tvec) {
+    std::vector<cv::Point2f> planePoints, normalized;
+    for (const cv::Vec3f& point : objectPoints) {
+        planePoints.push_back(cv::Point2f(point[0], point[1]));
+    }
+    cv::undistortPoints(imagePoints, normalized, cameraMatrix, distCoeffs);
+    cv::Mat H = cv::findHomography(planePoints, normalized);
+    if (H.empty()) {
+        return false;
+    }
+
+    // In normalized coordinates H = lambda * [r1 r2 t]
+    cv::Vec3d h1(H.at<double>(0, 0), H.at<double>(1, 0), H.at<double>(2, 0));
+    cv::Vec3d h2(H.at<double>(0, 1), H.at<double>(1, 1), H.at<double>(2, 1));
+    cv::Vec3d h3(H.at<double>(0, 2), H.at<double>(1, 2), H.at<double>(2, 2));
+    double scale = 2.0 / (cv::norm(h1) + cv::norm(h2));
+    if (h3[2] < 0.0) {
+        scale = -scale;  // The board has to be in front of the camera
+    }
+    cv::Vec3d r1 = h1 * scale, r2 = h2 * scale, r3 = r1.cross(r2);
+    cv::Matx33d R(r1[0], r2[0], r3[0], r1[1], r2[1], r3[1], r1[2], r2[2], r3[2]);
+
+    // Nearest true rotation
+    cv::Matx33d U, Vt;
+    cv::Matx31d w;
+    cv::SVD::compute(R, w, U, Vt);
+    rvec = rotationVector(U * Vt);
+    tvec = h3 * scale;
+    return true;
+}
+
+PoseEstimator::PoseEstimator(const cv::Size& patternSize) : boardPoints(boardObjectPoints(patternSize)) {}
+
+bool PoseEstimator::predictCorners(TimePoint t, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, std::vector<cv::Point2f>& corners) const {
+    cv::Vec3d rvec, tvec;
+    if (!warmStart || !predictor.predict(t, rvec, tvec) || tvec[2] <= 0.0) {
+        return false;
+    }
+    cv::projectPoints(boardPoints, rvec, tvec, cameraMatrix, distCoeffs, corners);
+    return true;
+}
+
+bool PoseEstimator::estimate(const std::vector<cv::Point2f>& corners, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs,
+    TimePoint t, cv::Mat& rvec, cv::Mat& tvec) {
+    if (corners.size() != boardPoints.size()) {
+        return false;
+    }
+
+    cv::Vec3d r, tr;
+    bool solved = false;
+    if (warmStart && predictor.predict(t, r, tr)) {
+        Clock::time_point start = Clock::now();
+        double rms = 0.0;
+        int iterations;
+        {
+            PROFILE_SCOPE("refinePose");
+            iterations = refinePose(boardPoints, corners, cameraMatrix, distCoeffs, r, tr, maxIterations, &rms, &scratch);
+        }
+        PROFILE_COUNT("poseIterations", iterations);
+        solved = rms <= maxWarmRms;
+        if (solved) {
+            poseStats.warmSolves++;
+            poseStats.warmIterations += iterations;
+            poseStats.warmMs += elapsedMs(start, Clock::now());
+        }
+        else {
+            poseStats.fallbacks++;
+        }
+
+        if (solved && compareCold) {
+            // What the same frame would have cost without the prediction
+            cv::Mat coldRvec, coldTvec;
+            Clock::time_point referenceStart = Clock::now();
+            cv::solvePnP(boardPoints, corners, cameraMatrix, distCoeffs, coldRvec, coldTvec);
+            poseStats.coldReferenceMs += elapsedMs(referenceStart, Clock::now());
+            poseStats.comparisons++;
+            cv::Vec3d coldR, coldT;
+            if (planarPoseFromHomography(boardPoints, corners, cameraMatrix, distCoeffs, coldR, coldT)) {
+                poseStats.coldIterations += refinePose(boardPoints, corners, cameraMatrix, distCoeffs, coldR, coldT, maxIterations);
+            }
+        }
+    }
+
+    if (!solved) {
+        PROFILE_SCOPE("solvePnP");
+        Clock::time_point start = Clock::now();
+        cv::Mat coldRvec, coldTvec;
+        if (!cv::solvePnP(boardPoints, corners, cameraMatrix, distCoeffs, coldRvec, coldTvec)) {
+            return false;
+        }
+        poseStats.coldSolves++;
+        poseStats.coldMs += elapsedMs(start, Clock::now());
+        r = readVec3d(coldRvec);
+        tr = readVec3d(coldTvec);
+    }
+
+    cv::Vec3d smoothedR, smoothedT;
+    predictor.update(t, r, tr, smoothedR, smoothedT);
+    writeVec3d(smooth ? smoothedR : r, rvec);
+    writeVec3d(smooth ? smoothedT : tr, tvec);
+    return true;
+}
+
+void PoseEstimator::observe(TimePoint t, const cv::Mat& rvec, const cv::Mat& tvec) {
+    cv::Vec3d smoothedR, smoothedT;
+    predictor.update(t, readVec3d(rvec), readVec3d(tvec), smoothedR, smoothedT);
+}
+
+void printPoseStats(const PoseStats& stats) {
+    if (stats.warmSolves + stats.coldSolves == 0) {
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Pose estimation: " << stats.warmSolves << " warm-started (mean " << stats.meanWarmIterations() << " iterations, "
+        << stats.meanWarmMs() << " ms), " << stats.coldSolves << " from scratch (mean " << stats.meanColdMs() << " ms), "
+        << stats.fallbacks << " warm solves rejected" << std::endl;
+    if (stats.comparisons > 0) {
+        std::cout << "  same frames from scratch: cv::solvePnP mean " << stats.coldReferenceMs / stats.comparisons << " ms, refinement from the homography pose mean "
+            << double(stats.coldIterations) / stats.comparisons << " iterations" << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
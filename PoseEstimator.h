@@ -0,0 +1,105 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+// Where each frame's pose came from and what it cost
+struct PoseStats {
+    int64_t warmSolves = 0;         // Poses refined from the predicted pose
+    int64_t warmIterations = 0;
+    double warmMs = 0.0;
+    int64_t coldSolves = 0;         // Poses solved from scratch with cv::solvePnP (no prediction yet, or a rejected warm solve)
+    double coldMs = 0.0;
+    int64_t fallbacks = 0;          // Warm solves rejected for a large re-projection error
+
+    // The cold path run on the same frames for comparison (only when compareCold is set)
+    int64_t comparisons = 0;
+    int64_t coldIterations = 0;     // Iterations of the same refinement started from the homography pose
+    double coldReferenceMs = 0.0;   // cv::solvePnP from scratch, as main.cpp did before
+
+    double meanWarmIterations() const { return warmSolves > 0 ? double(warmIterations) / warmSolves : 0.0; }
+    double meanWarmMs() const { return warmSolves > 0 ? warmMs / warmSolves : 0.0; }
+    double meanColdMs() const { return coldSolves > 0 ? coldMs / coldSolves : 0.0; }
+};
+
+// Constant-velocity model of the board pose with alpha-beta smoothing. Rotations are blended on the
+// rotation group (not by adding Rodrigues vectors) so the filter behaves the same at any orientation.
+class PosePredictor {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    void reset() { hasState = false; }
+    bool valid() const { return hasState; }
+
+    // Pose extrapolated to time t; false without a recent pose
+    bool predict(TimePoint t, cv::Vec3d& rvec, cv::Vec3d& tvec) const;
+
+    // Blend a measured pose into the state and return the smoothed pose
+    void update(TimePoint t, const cv::Vec3d& rvec, const cv::Vec3d& tvec, cv::Vec3d& smoothedRvec, cv::Vec3d& smoothedTvec);
+
+    double alpha = 0.7;          // Weight of the measurement against the prediction
+    double beta = 0.2;           // Weight of the residual in the velocity update
+    double maxGapSeconds = 0.5;  // Older states are not extrapolated
+
+private:
+    cv::Matx33d rotation;
+    cv::Vec3d translation, angularVelocity, linearVelocity;  // Velocities per second
+    TimePoint lastTime;
+    bool hasState = false;
+};
+
+// Buffers refinePose can reuse between calls instead of allocating them each time
+struct PoseScratch {
+    std::vector<cv::Point2f> projected;
+    cv::Mat jacobian;
+};
+
+// Levenberg-Marquardt refinement of a pose from a starting guess, using projectPoints' Jacobian.
+// Returns the number of iterations and the final RMS re-projection error through rms.
+int refinePose(const std::vector<cv::Vec3f>& objectPoints, const std::vector<cv::Point2f>& imagePoints,
+    const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Vec3d& rvec, cv::Vec3d& tvec, int maxIterations, double* rms = nullptr,
+    PoseScratch* scratch = nullptr);
+
+// Closed-form pose of a planar target (z = 0) from its homography, the usual starting point of an iterative solve
+bool planarPoseFromHomography(const std::vector<cv::Vec3f>& objectPoints, const std::vector<cv::Point2f>& imagePoints,
+    const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Vec3d& rvec, cv::Vec3d& tvec);
+
+// Board pose from detected corners: predicts the pose, refines it from the prediction, and smooths the result
+class PoseEstimator {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    explicit PoseEstimator(const cv::Size& patternSize);
+
+    // The board's corners in board units, built once for the pattern size
+    const std::vector<cv::Vec3f>& objectPoints() const { return boardPoints; }
+
+    // Where the board's corners should be at time t; false without a prediction
+    bool predictCorners(TimePoint t, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, std::vector<cv::Point2f>& corners) const;
+
+    // Solve the pose for detected corners captured at time t; rvec and tvec receive the (smoothed) pose
+    bool estimate(const std::vector<cv::Point2f>& corners, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs,
+        TimePoint t, cv::Mat& rvec, cv::Mat& tvec);
+
+    // Feed a pose found another way (e.g. from features) so the prediction stays current
+    void observe(TimePoint t, const cv::Mat& rvec, const cv::Mat& tvec);
+
+    void reset() { predictor.reset(); }
+
+    const PoseStats& stats() const { return poseStats; }
+
+    bool warmStart = true;      // Refine from the prediction; otherwise always solve from scratch like before
+    bool smooth = true;         // Return the filtered pose instead of the raw solution
+    bool compareCold = false;   // Also run the cold path on every frame and record its cost
+    int maxIterations = 20;
+    double maxWarmRms = 2.0;    // Warm solutions with a larger RMS error (pixels) are redone from scratch
+
+private:
+    std::vector<cv::Vec3f> boardPoints;
+    PoseScratch scratch;
+    PosePredictor predictor;
+    PoseStats poseStats;
+};
+
+void printPoseStats(const PoseStats& stats);
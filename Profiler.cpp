@@ -0,0 +1,326 @@
+#include "Profiler.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace profiler_detail {
+std::atomic<bool> enabled(false);
+}
+
+namespace {
+
+struct ProfileEvent {
+    const char* name;
+    uint64_t startNs;
+    uint64_t durationNs;
+    double value;
+    bool isCounter;
+};
+
+// Ring slot; relaxed atomics so a slot the owner overwrites while it is copied is a stale value, not a data race
+struct EventSlot {
+    std::atomic<const char*> name{ nullptr };
+    std::atomic<uint64_t> startNs{ 0 }, durationNs{ 0 };
+    std::atomic<double> value{ 0.0 };
+    std::atomic<bool> isCounter{ false };
+
+    void store(const ProfileEvent& event) {
+        name.store(event.name, std::memory_order_relaxed);
+        startNs.store(event.startNs, std::memory_order_relaxed);
+        durationNs.store(event.durationNs, std::memory_order_relaxed);
+        value.store(event.value, std::memory_order_relaxed);
+        isCounter.store(event.isCounter, std::memory_order_relaxed);
+    }
+
+    ProfileEvent load() const {
+        return { name.load(std::memory_order_relaxed), startNs.load(std::memory_order_relaxed), durationNs.load(std::memory_order_relaxed),
+            value.load(std::memory_order_relaxed), isCounter.load(std::memory_order_relaxed) };
+    }
+};
+
+// Single-producer ring owned by one thread. The owner writes a slot and then publishes it by advancing
+// writeIndex; the collector copies published slots and discards any the owner may have overwritten meanwhile.
+struct ThreadRing {
+    static const uint64_t capacity = 1 << 14;
+    EventSlot events[capacity];
+    std::atomic<uint64_t> writeIndex{ 0 };
+    std::atomic<bool> retired{ false };   // The owner thread has exited; freed once drained
+    uint64_t readIndex = 0;      // Only touched by the collector
+    int threadId = 0;
+};
+
+// Ring registry; the mutex is only taken when a thread records its first event, when it is named, and by the collector
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadRing>> rings;
+std::map<int, std::string> threadNames;   // Kept after a ring is freed, for the trace's thread names
+int nextThreadId = 1;
+
+// Marks the thread's ring retired when the thread exits, so the collector can free it after its last drain
+struct RingOwner {
+    ThreadRing* ring = nullptr;
+    ~RingOwner() {
+        if (ring) ring->retired.store(true, std::memory_order_release);
+    }
+};
+
+thread_local RingOwner localRing;
+thread_local std::string localThreadName;
+
+// The ring is only created for a thread that records an event, i.e. while profiling is on
+ThreadRing& threadRing() {
+    if (!localRing.ring) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        rings.push_back(std::make_unique<ThreadRing>());
+        localRing.ring = rings.back().get();
+        localRing.ring->threadId = nextThreadId++;
+        threadNames[localRing.ring->threadId] = localThreadName.empty() ? "thread " + std::to_string(localRing.ring->threadId) : localThreadName;
+    }
+    return *localRing.ring;
+}
+
+void push(const ProfileEvent& event) {
+    ThreadRing& ring = threadRing();
+    uint64_t index = ring.writeIndex.load(std::memory_order_relaxed);
+    // Pairs with the collector's acquire fence: if it sees any part of this event, it also sees writeIndex == index
+    std::atomic_thread_fence(std::memory_order_release);
+    ring.events[index & (ThreadRing::capacity - 1)].store(event);
+    ring.writeIndex.store(index + 1, std::memory_order_release);
+}
+
+// Upper bounds (milliseconds) of the latency histogram buckets; the last bucket is open-ended
+const double bucketBoundsMs[] = { 0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.0, 33.0, 66.0, 133.0 };
+const int bucketCount = int(sizeof(bucketBoundsMs) / sizeof(bucketBoundsMs[0])) + 1;
+
+struct Summary {
+    bool isCounter = false;
+    int64_t count = 0;
+    double sum = 0.0;    // Milliseconds for scopes, values for counters
+    double max = 0.0;
+    int64_t buckets[bucketCount] = {};
+
+    void add(double v) {
+        if (count == 0 || v > max) max = v;
+        count++;
+        sum += v;
+        if (!isCounter) {
+            int bucket = int(std::upper_bound(bucketBoundsMs, bucketBoundsMs + bucketCount - 1, v) - bucketBoundsMs);
+            buckets[bucket]++;
+        }
+    }
+
+    // Upper bound of the bucket holding the p-th percentile, not a measured latency
+    double percentileMs(double p) const {
+        int64_t target = int64_t(p / 100.0 * count + 0.5), seen = 0;
+        for (int i = 0; i < bucketCount - 1; ++i) {
+            seen += buckets[i];
+            if (seen >= std::max<int64_t>(target, 1)) return bucketBoundsMs[i];
+        }
+        return max;
+    }
+};
+
+// Collector state, guarded by collectorMutex
+std::mutex collectorMutex;
+std::map<std::string, Summary> summaries;
+std::vector<ProfileEvent> trace;          // Retained events, used as a ring once full
+std::vector<int> traceThreads;            // Thread id of each retained event
+size_t traceHead = 0;
+const size_t maxTraceEvents = 1 << 20;
+int64_t lostEvents = 0;
+uint64_t lastSummaryNs = 0;
+
+void retain(const ProfileEvent& event, int threadId) {
+    if (trace.size() < maxTraceEvents) {
+        trace.push_back(event);
+        traceThreads.push_back(threadId);
+        return;
+    }
+    trace[traceHead] = event;
+    traceThreads[traceHead] = threadId;
+    traceHead = (traceHead + 1) % maxTraceEvents;
+}
+
+void collectLocked() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::vector<ProfileEvent> copied;
+    for (std::unique_ptr<ThreadRing>& ring : rings) {
+        // Read before writeIndex: a retired ring's owner has published its last event
+        bool retired = ring->retired.load(std::memory_order_acquire);
+        uint64_t end = ring->writeIndex.load(std::memory_order_acquire);
+        uint64_t begin = std::max(ring->readIndex, end > ThreadRing::capacity ? end - ThreadRing::capacity : 0);
+        lostEvents += int64_t(begin - ring->readIndex);
+        copied.clear();
+        for (uint64_t i = begin; i < end; ++i) {
+            copied.push_back(ring->events[i & (ThreadRing::capacity - 1)].load());
+        }
+
+        // Slots the owner reused while we were copying are no longer the events we wanted. The owner may be
+        // part-way through writing event `after`, which shares a slot with event after - capacity, so that one is dropped too.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = ring->writeIndex.load(std::memory_order_relaxed);
+        uint64_t firstValid = after >= ThreadRing::capacity ? after - ThreadRing::capacity + 1 : 0;
+        for (uint64_t i = begin; i < end; ++i) {
+            if (i < firstValid) {
+                lostEvents++;
+                continue;
+            }
+            const ProfileEvent& event = copied[size_t(i - begin)];
+            Summary& summary = summaries[event.name];
+            summary.isCounter = event.isCounter;
+            summary.add(event.isCounter ? event.value : event.durationNs / 1e6);
+            retain(event, ring->threadId);
+        }
+        ring->readIndex = end;
+        if (retired) {
+            ring.reset();
+        }
+    }
+    rings.erase(std::remove(rings.begin(), rings.end(), nullptr), rings.end());
+}
+
+std::string csvField(const std::string& text) {
+    return text.find_first_of(",\"") == std::string::npos ? text : "\"" + text + "\"";
+}
+
+} // namespace
+
+void setProfilingEnabled(bool enabled) {
+    profiler_detail::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void profilerSetThreadName(const char* name) {
+    localThreadName = name;
+    if (localRing.ring) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        threadNames[localRing.ring->threadId] = name;
+    }
+}
+
+uint64_t profilerNowNs() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void recordProfileScope(const char* name, uint64_t startNs, uint64_t endNs) {
+    push({ name, startNs, endNs - startNs, 0.0, false });
+}
+
+void recordProfileCounter(const char* name, double value) {
+    push({ name, profilerNowNs(), 0, value, true });
+}
+
+void collectProfile() {
+    std::lock_guard<std::mutex> lock(collectorMutex);
+    collectLocked();
+}
+
+bool profileHasEvents() {
+    std::lock_guard<std::mutex> lock(collectorMutex);
+    return !trace.empty();
+}
+
+bool writeChromeTrace(const std::string& path) {
+    std::lock_guard<std::mutex> lock(collectorMutex);
+    collectLocked();
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Error: could not write trace " << path << std::endl;
+        return false;
+    }
+
+    uint64_t originNs = UINT64_MAX;
+    for (const ProfileEvent& event : trace) {
+        originNs = std::min(originNs, event.startNs);
+    }
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    {
+        std::lock_guard<std::mutex> registryLock(registryMutex);
+        for (const auto& thread : threadNames) {
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.first
+                << ",\"args\":{\"name\":\"" << thread.second << "\"}}";
+            first = false;
+        }
+    }
+    // Oldest first, so the ring's wrap point is not visible in the file
+    for (size_t n = 0; n < trace.size(); ++n) {
+        size_t i = (traceHead + n) % trace.size();
+        const ProfileEvent& event = trace[i];
+        double ts = (event.startNs - originNs) / 1e3;
+        out << (first ? "" : ",\n");
+        first = false;
+        if (event.isCounter) {
+            out << "{\"name\":\"" << event.name << "\",\"ph\":\"C\",\"ts\":" << ts << ",\"pid\":1,\"tid\":" << traceThreads[i]
+                << ",\"args\":{\"value\":" << event.value << "}}";
+        }
+        else {
+            out << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"ts\":" << ts << ",\"dur\":" << event.durationNs / 1e3
+                << ",\"pid\":1,\"tid\":" << traceThreads[i] << "}";
+        }
+    }
+    out << "\n]}\n";
+    std::cout << "Trace with " << trace.size() << " events written to " << path;
+    if (lostEvents > 0) std::cout << " (" << lostEvents << " events lost to full thread buffers)";
+    std::cout << std::endl;
+    return out.good();
+}
+
+bool writeProfileSummaryCsv(const std::string& path) {
+    std::lock_guard<std::mutex> lock(collectorMutex);
+    collectLocked();
+    if (summaries.empty()) {
+        return true;
+    }
+    std::error_code error;
+    bool writeHeader = !std::filesystem::exists(path, error);
+    std::ofstream out(path, std::ios::app);
+    if (!out.is_open()) {
+        return false;
+    }
+    if (writeHeader) {
+        out << "time_s,name,kind,count,mean,p50_le_ms,p90_le_ms,p99_le_ms,max";
+        for (int i = 0; i < bucketCount - 1; ++i) out << ",le_" << bucketBoundsMs[i] << "ms";
+        out << ",gt_" << bucketBoundsMs[bucketCount - 2] << "ms\n";
+    }
+    double timeSeconds = profilerNowNs() / 1e9;
+    out << std::fixed << std::setprecision(4);
+    for (const auto& entry : summaries) {
+        const Summary& summary = entry.second;
+        double mean = summary.count > 0 ? summary.sum / summary.count : 0.0;
+        out << timeSeconds << "," << csvField(entry.first) << "," << (summary.isCounter ? "counter" : "scope_ms") << "," << summary.count << "," << mean;
+        if (summary.isCounter) {
+            out << ",,,," << summary.max;
+            for (int i = 0; i < bucketCount; ++i) out << ",";
+        }
+        else {
+            out << "," << summary.percentileMs(50) << "," << summary.percentileMs(90) << "," << summary.percentileMs(99) << "," << summary.max;
+            for (int i = 0; i < bucketCount; ++i) out << "," << summary.buckets[i];
+        }
+        out << "\n";
+    }
+    summaries.clear();
+    lastSummaryNs = profilerNowNs();
+    return out.good();
+}
+
+void profilerTick(const std::string& csvPath, double intervalSeconds) {
+    uint64_t now = profilerNowNs();
+    bool due;
+    {
+        std::lock_guard<std::mutex> lock(collectorMutex);
+        if (lastSummaryNs == 0) lastSummaryNs = now;
+        collectLocked();
+        due = (now - lastSummaryNs) / 1e9 >= intervalSeconds;
+    }
+    if (due) {
+        writeProfileSummaryCsv(csvPath);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Lightweight scoped timers and counters for the hot path.
+// Each thread records into its own lock-free ring buffer; one collector thread drains the rings into
+// latency histograms (written as periodic CSV summaries) and a retained trace (written as Chrome trace-event JSON).
+// Event names must be string literals or otherwise outlive the profiler.
+
+namespace profiler_detail {
+extern std::atomic<bool> enabled;
+}
+
+inline bool profilingEnabled() {
+    return profiler_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Switch recording on or off at runtime; when off a scope costs one relaxed atomic load
+void setProfilingEnabled(bool enabled);
+
+// Name the calling thread in exported traces; its event ring is only allocated once it records an event
+void profilerSetThreadName(const char* name);
+
+// Nanoseconds on the steady clock
+uint64_t profilerNowNs();
+
+void recordProfileScope(const char* name, uint64_t startNs, uint64_t endNs);
+void recordProfileCounter(const char* name, double value);
+
+// Times the enclosing scope when profiling was on at its start
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) : name(profilingEnabled() ? name : nullptr), startNs(this->name ? profilerNowNs() : 0) {}
+    ~ProfileScope() {
+        if (name) recordProfileScope(name, startNs, profilerNowNs());
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* name;
+    uint64_t startNs;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_COUNT(name, value) do { if (profilingEnabled()) recordProfileCounter(name, double(value)); } while (0)
+
+// Drain every thread's ring into the summary and the retained trace. Safe to call from any one thread at a time.
+void collectProfile();
+
+// Write the retained events as Chrome trace-event JSON (open in chrome://tracing or Perfetto)
+bool writeChromeTrace(const std::string& path);
+
+// Append one row per scope and counter for the interval since the last summary (count, mean, percentiles,
+// max and histogram bucket counts), then start a new interval
+bool writeProfileSummaryCsv(const std::string& path);
+
+// Collect, and append a CSV summary once intervalSeconds have passed since the previous one
+void profilerTick(const std::string& csvPath, double intervalSeconds);
+
+// True if any event has been retained for the trace
+bool profileHasEvents();
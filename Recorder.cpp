@@ -0,0 +1,181 @@
+#include "Recorder.h"
+#include "Profiler.h"
+#include "Timing.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// recording.avi -> recording_2.avi for the second session, and so on
+std::string sessionFile(const std::string& path, int session) {
+    if (session <= 1) {
+        return path;
+    }
+    std::filesystem::path file(path);
+    std::filesystem::path name = file.stem().string() + "_" + std::to_string(session) + file.extension().string();
+    return (file.parent_path() / name).string();
+}
+
+} // namespace
+
+Recorder::Recorder(const RecorderConfig& config) : config(config), queue(config.queueDepth), sessionPath(config.path) {}
+
+Recorder::~Recorder() {
+    stop();
+    if (encoder.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            quitting = true;
+        }
+        wake.notify_one();
+        encoder.join();
+    }
+}
+
+bool Recorder::start() {
+    if (running) {
+        return true;
+    }
+    if (config.codec.size() != 4) {
+        std::cerr << "Error: codec must be a four character code such as MJPG, not " << config.codec << std::endl;
+        return false;
+    }
+    int session = sessions + 1;
+    std::string videoPath = sessionFile(config.path, session);
+    std::string sidecarPath = config.sidecarPath.empty() ? videoPath + ".poses.csv" : sessionFile(config.sidecarPath, session);
+    sidecar.open(sidecarPath);
+    if (!sidecar.is_open()) {
+        std::cerr << "Error: could not open pose sidecar " << sidecarPath << std::endl;
+        return false;
+    }
+    sidecar << "frame,time_ms,found,pose_valid,from_features,undistorted,rvec_x,rvec_y,rvec_z,tvec_x,tvec_y,tvec_z\n";
+    sidecar << std::setprecision(9);
+
+    sessions = session;
+    sessionPath = videoPath;
+    sessionSidecarPath = sidecarPath;
+    recorderStats = RecorderStats();
+    writerFailed = false;
+    hasStart = false;
+    running = true;
+    if (!encoder.joinable()) {
+        encoder = std::thread(&Recorder::encoderLoop, this);
+    }
+    std::cout << "Recording to " << sessionPath << " (" << config.codec << ", " << config.fps << " fps), poses to " << sessionSidecarPath << std::endl;
+    return true;
+}
+
+void Recorder::stop() {
+    if (!running) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    stopping = true;
+    wake.notify_one();
+    stopped.wait(lock, [this] { return !stopping; });
+    running = false;
+}
+
+bool Recorder::submit(cv::Mat& frame, const RecordedPose& pose, Clock::time_point captureTime) {
+    if (!running || frame.empty()) {
+        return false;
+    }
+    Clock::time_point t0 = Clock::now();
+    recorderStats.submitted++;
+    if (!hasStart) {
+        startTime = captureTime;
+        hasStart = true;
+    }
+
+    Entry* entry = queue.beginPush();
+    if (!entry) {
+        recorderStats.dropped++;
+        PROFILE_COUNT("recordDropped", recorderStats.dropped);
+        return false;
+    }
+    // Swap instead of copying: the encoder gets this frame and the caller gets a buffer it already wrote
+    cv::swap(entry->frame, frame);
+    entry->pose = pose;
+    entry->pose.timeMs = elapsedMs(startTime, captureTime);
+    queue.endPush();
+    wake.notify_one();  // Without the lock, so the render thread never waits on the encoder
+
+    recorderStats.maxQueued = std::max(recorderStats.maxQueued, queue.size());
+    double ms = elapsedMs(t0, Clock::now());
+    recorderStats.handoffTotalMs += ms;
+    recorderStats.handoffMaxMs = std::max(recorderStats.handoffMaxMs, ms);
+    return true;
+}
+
+void Recorder::encoderLoop() {
+    profilerSetThreadName("encoder");
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    while (true) {
+        // submit() notifies without taking the lock, so a wake-up can slip in between the check and the wait;
+        // the timeout bounds how long such a frame waits
+        wake.wait_for(lock, std::chrono::milliseconds(50), [this] { return quitting || stopping || queue.front() != nullptr; });
+        if (quitting) {
+            break;
+        }
+        lock.unlock();
+        while (Entry* entry = queue.front()) {
+            write(*entry);
+            queue.pop();
+        }
+        lock.lock();
+
+        // stop() is called from the thread that submits, so everything submitted before it has been written
+        if (stopping) {
+            writer.release();
+            sidecar.close();
+            stopping = false;
+            stopped.notify_one();
+        }
+    }
+}
+
+void Recorder::write(Entry& entry) {
+    PROFILE_SCOPE("encodeFrame");
+    Clock::time_point t0 = Clock::now();
+
+    // The video size is only known once the first frame arrives
+    if (!writer.isOpened() && !writerFailed) {
+        int fourcc = cv::VideoWriter::fourcc(config.codec[0], config.codec[1], config.codec[2], config.codec[3]);
+        if (!writer.open(sessionPath, fourcc, config.fps, entry.frame.size(), entry.frame.channels() == 3)) {
+            std::cerr << "Error: could not open " << sessionPath << " for writing with codec " << config.codec << std::endl;
+            writerFailed = true;
+        }
+    }
+    if (writer.isOpened()) {
+        writer.write(entry.frame);
+    }
+
+    const RecordedPose& pose = entry.pose;
+    sidecar << pose.frameIndex << ',' << pose.timeMs << ',' << pose.found << ',' << pose.poseValid << ','
+        << pose.fromFeatures << ',' << pose.undistorted;
+    for (int i = 0; i < 3; ++i) sidecar << ',' << pose.rvec[i];
+    for (int i = 0; i < 3; ++i) sidecar << ',' << pose.tvec[i];
+    sidecar << '\n';
+
+    recorderStats.written++;
+    double ms = elapsedMs(t0, Clock::now());
+    recorderStats.encodeTotalMs += ms;
+    recorderStats.encodeMaxMs = std::max(recorderStats.encodeMaxMs, ms);
+}
+
+void printRecorderStats(const RecorderStats& stats, const std::string& path) {
+    if (stats.submitted == 0) {
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Recording " << path << ": " << stats.written << " frames written, " << stats.dropped << " dropped ("
+        << 100.0 * stats.dropped / stats.submitted << "%), queue peak " << stats.maxQueued << std::endl;
+    std::cout << "  hand-off mean " << stats.handoffTotalMs / std::max<int64_t>(stats.submitted - stats.dropped, 1)
+        << " ms (max " << stats.handoffMaxMs << "), encode mean " << stats.encodeTotalMs / std::max<int64_t>(stats.written, 1)
+        << " ms (max " << stats.encodeMaxMs << ")" << std::endl;
+    std::cout << std::defaultfloat;
+}
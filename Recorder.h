@@ -0,0 +1,102 @@
+#pragma once
+#include "SpscRing.h"
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+
+struct RecorderConfig {
+    std::string path = "recording.avi";  // The container follows the extension (.avi, .mp4, .mkv, ...)
+    std::string codec = "MJPG";          // FourCC of the video codec, e.g. MJPG, XVID, mp4v, avc1
+    double fps = 30.0;
+    size_t queueDepth = 8;               // Frames waiting for the encoder before new ones are dropped
+    std::string sidecarPath;             // Per-frame pose CSV; empty for <video>.poses.csv
+};
+
+// What the overlay knew about one recorded frame
+struct RecordedPose {
+    int64_t frameIndex = 0;
+    double timeMs = 0.0;           // Capture time since the recording started
+    bool found = false;            // Board corners available (detected or from features)
+    bool poseValid = false;
+    bool fromFeatures = false;     // Pose kept from board-anchored features
+    bool undistorted = false;
+    cv::Vec3d rvec, tvec;
+};
+
+struct RecorderStats {
+    int64_t submitted = 0;
+    int64_t written = 0;
+    int64_t dropped = 0;           // Encoder queue was full
+    size_t maxQueued = 0;
+    double handoffTotalMs = 0.0, handoffMaxMs = 0.0;   // Time the render thread spent handing frames over
+    double encodeTotalMs = 0.0, encodeMaxMs = 0.0;     // Time the encoder thread spent per frame
+};
+
+// Writes annotated frames and a pose sidecar on a background thread.
+// The render thread hands each frame over through a lock-free ring by swapping buffers, so it never copies or
+// encodes; when the encoder falls behind, new frames are dropped and counted instead of stalling the overlay.
+// Each start() begins a new session: the first writes to the configured paths, later ones add _2, _3, ... to the
+// file names so an earlier recording is never overwritten. One encoder thread serves every session and is parked
+// on a condition variable while there is nothing to write.
+class Recorder {
+public:
+    explicit Recorder(const RecorderConfig& config);
+    ~Recorder();
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    // Open the sidecar and start the encoder thread on the first session; the video file is opened with the
+    // first frame's size. Resets the stats for the new session.
+    bool start();
+
+    // Wait for the encoder to write the frames still queued and close both files
+    void stop();
+
+    bool isRecording() const { return running; }
+
+    // Render thread only. Takes the frame's buffer and leaves a free buffer of an earlier frame in its place.
+    // Returns false if the frame was dropped because the encoder queue is full.
+    bool submit(cv::Mat& frame, const RecordedPose& pose, std::chrono::steady_clock::time_point captureTime);
+
+    // Counters of the current or last session, updated by both threads; read them after stop()
+    const RecorderStats& stats() const { return recorderStats; }
+
+    // Video file of the current or last session
+    const std::string& path() const { return sessionPath; }
+
+private:
+    struct Entry {
+        cv::Mat frame;
+        RecordedPose pose;
+    };
+
+    void encoderLoop();
+    void write(Entry& entry);
+
+    RecorderConfig config;
+    SpscRing<Entry> queue;
+    int sessions = 0;
+    std::string sessionPath, sessionSidecarPath;
+    std::thread encoder;
+    std::atomic<bool> running{false};
+    std::mutex wakeMutex;
+    std::condition_variable wake;      // Frame queued, stop or quit requested
+    std::condition_variable stopped;   // The encoder finished a session
+    bool stopping = false;             // Guarded by wakeMutex
+    bool quitting = false;
+    cv::VideoWriter writer;
+    std::ofstream sidecar;
+    bool writerFailed = false;
+    bool hasStart = false;
+    std::chrono::steady_clock::time_point startTime;
+    RecorderStats recorderStats;
+};
+
+void printRecorderStats(const RecorderStats& stats, const std::string& path);
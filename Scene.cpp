@@ -0,0 +1,304 @@
+#include "Scene.h"
+#include "MeshSimplification.h"
+#include "Profiler.h"
+#include "Timing.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Rotation about the board normal
+cv::Matx33f yawRotation(float degrees) {
+    float a = degrees * float(CV_PI / 180.0);
+    float c = std::cos(a), s = std::sin(a);
+    return cv::Matx33f(c, -s, 0.0f, s, c, 0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+// The four side planes of the camera frustum through the camera centre, as unit normals pointing inwards.
+// The image is widened by a margin on each side so distorted edges are not culled too early.
+void frustumPlanes(const CameraIntrinsics& c, const cv::Size& imageSize, float margin, cv::Vec3d planes[4]) {
+    double mx = margin * imageSize.width, my = margin * imageSize.height;
+    planes[0] = cv::normalize(cv::Vec3d(c.fx, 0.0, c.cx + mx));                        // u >= -mx
+    planes[1] = cv::normalize(cv::Vec3d(-c.fx, 0.0, imageSize.width + mx - c.cx));     // u <= width + mx
+    planes[2] = cv::normalize(cv::Vec3d(0.0, c.fy, c.cy + my));                        // v >= -my
+    planes[3] = cv::normalize(cv::Vec3d(0.0, -c.fy, imageSize.height + my - c.cy));    // v <= height + my
+}
+
+} // namespace
+
+void meshBoundingSphere(const Mesh& mesh, cv::Vec3f& center, float& radius) {
+    center = cv::Vec3f(0.0f, 0.0f, 0.0f);
+    radius = 0.0f;
+    if (mesh.vertexCount() == 0) {
+        return;
+    }
+    auto [minX, maxX] = std::minmax_element(mesh.px.begin(), mesh.px.end());
+    auto [minY, maxY] = std::minmax_element(mesh.py.begin(), mesh.py.end());
+    auto [minZ, maxZ] = std::minmax_element(mesh.pz.begin(), mesh.pz.end());
+    center = cv::Vec3f((*minX + *maxX) * 0.5f, (*minY + *maxY) * 0.5f, (*minZ + *maxZ) * 0.5f);
+    float radiusSq = 0.0f;
+    for (size_t i = 0; i < mesh.vertexCount(); ++i) {
+        float dx = mesh.px[i] - center[0], dy = mesh.py[i] - center[1], dz = mesh.pz[i] - center[2];
+        radiusSq = std::max(radiusSq, dx * dx + dy * dy + dz * dz);
+    }
+    radius = std::sqrt(radiusSq);
+}
+
+int Scene::addModel(const std::string& name, const std::string& path) {
+    int existing = findModel(name);
+    if (existing >= 0) {
+        return existing;
+    }
+    SceneModel model;
+    model.name = name;
+    if (!loadOBJMeshLods(path, model.levels)) {
+        std::cerr << "Error: could not load model " << name << " from " << path << std::endl;
+        return -1;
+    }
+    meshBoundingSphere(model.levels[0], model.boundsCenter, model.boundsRadius);
+    for (Mesh& level : model.levels) {
+        // The rasterizer needs triangles; the edge list keeps the polygon outlines for the wireframe
+        triangulateMesh(level);
+        model.levelTriangles.push_back(triangleCount(level));
+        // Simplified levels may move vertices slightly outside the full mesh
+        for (size_t i = 0; i < level.vertexCount(); ++i) {
+            float dx = level.px[i] - model.boundsCenter[0], dy = level.py[i] - model.boundsCenter[1], dz = level.pz[i] - model.boundsCenter[2];
+            model.boundsRadius = std::max(model.boundsRadius, std::sqrt(dx * dx + dy * dy + dz * dz));
+        }
+    }
+    sceneModels.push_back(std::move(model));
+    return int(sceneModels.size()) - 1;
+}
+
+int Scene::findModel(const std::string& name) const {
+    for (size_t i = 0; i < sceneModels.size(); ++i) {
+        if (sceneModels[i].name == name) return int(i);
+    }
+    return -1;
+}
+
+void Scene::addInstance(int model, const cv::Vec3f& position, float yawDegrees, float scale) {
+    SceneInstance instance;
+    instance.model = model;
+    instance.rotation = yawRotation(yawDegrees);
+    instance.translation = position;
+    instance.scale = scale;
+    sceneInstances.push_back(instance);
+}
+
+bool Scene::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: could not open scene " << path << std::endl;
+        return false;
+    }
+    std::filesystem::path folder = std::filesystem::path(path).parent_path();
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); ++lineNumber) {
+        std::istringstream in(line);
+        std::string keyword, name;
+        if (!(in >> keyword) || keyword[0] == '#') {
+            continue;
+        }
+        in >> name;
+
+        if (keyword == "model") {
+            std::string modelPath;
+            std::getline(in >> std::ws, modelPath);
+            std::filesystem::path resolved(modelPath);
+            if (resolved.is_relative()) resolved = folder / resolved;
+            if (addModel(name, resolved.string()) < 0) return false;
+            continue;
+        }
+
+        int model = findModel(name);
+        if (model < 0) {
+            std::cerr << "Error: " << path << ":" << lineNumber << " uses model " << name << " before it is defined" << std::endl;
+            return false;
+        }
+        if (keyword == "instance") {
+            float x, y, z, yaw = 0.0f, scale = 1.0f;
+            if (!(in >> x >> y >> z)) {
+                std::cerr << "Error: " << path << ":" << lineNumber << " needs a position" << std::endl;
+                return false;
+            }
+            in >> yaw >> scale;
+            addInstance(model, cv::Vec3f(x, y, z), yaw, scale);
+        }
+        else if (keyword == "grid") {
+            int columns, rows;
+            float spacing, scale = 1.0f;
+            if (!(in >> columns >> rows >> spacing)) {
+                std::cerr << "Error: " << path << ":" << lineNumber << " needs columns, rows and spacing" << std::endl;
+                return false;
+            }
+            in >> scale;
+            for (int r = 0; r < rows; ++r) {
+                for (int c = 0; c < columns; ++c) {
+                    addInstance(model, cv::Vec3f(c * spacing, -r * spacing, 0.0f), 0.0f, scale);
+                }
+            }
+        }
+        else {
+            std::cerr << "Warning: " << path << ":" << lineNumber << " has unknown keyword " << keyword << std::endl;
+        }
+    }
+    return true;
+}
+
+void Scene::cull(const cv::Size& imageSize, const cv::Matx33d& R, const cv::Vec3d& t, const CameraIntrinsics& intrinsics) {
+    cv::Vec3d planes[4];
+    frustumPlanes(intrinsics, imageSize, cullMargin, planes);
+
+    // Cull whole instances by their bounding spheres before touching any vertex
+    visible.clear();
+    visibleLevel.clear();
+    for (size_t i = 0; i < sceneInstances.size(); ++i) {
+        const SceneInstance& instance = sceneInstances[i];
+        const SceneModel& model = sceneModels[instance.model];
+        cv::Vec3f boardCenter = instance.rotation * (instance.scale * model.boundsCenter) + instance.translation;
+        cv::Vec3d center = R * cv::Vec3d(boardCenter) + t;
+        double radius = double(model.boundsRadius) * instance.scale;
+        bool inside = center[2] + radius > nearPlane;
+        for (int p = 0; p < 4 && inside; ++p) {
+            inside = planes[p].dot(center) >= -radius;
+        }
+        if (!inside) {
+            continue;
+        }
+        visible.push_back(int(i));
+
+        // Pick the coarsest level that still has enough triangles for the sphere's projected area
+        int level = 0;
+        if (useLod && center[2] > radius) {
+            double radiusPixels = std::max(intrinsics.fx, intrinsics.fy) * radius / center[2];
+            double wanted = CV_PI * radiusPixels * radiusPixels / lodPixelsPerTriangle;
+            while (level + 1 < int(model.levels.size()) && double(model.levelTriangles[level + 1]) >= wanted) {
+                ++level;
+            }
+        }
+        visibleLevel.push_back(level);
+        if (sceneStats.levelDraws.size() <= size_t(level)) {
+            sceneStats.levelDraws.resize(level + 1, 0);
+        }
+        sceneStats.levelDraws[level]++;
+    }
+    sceneStats.frames++;
+    sceneStats.instancesTested += int64_t(sceneInstances.size());
+    sceneStats.instancesVisible += int64_t(visible.size());
+}
+
+void Scene::draw(cv::Mat& frame, const cv::Mat& rvec, const cv::Mat& tvec, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs) {
+    PROFILE_SCOPE("drawScene");
+    Clock::time_point t0 = Clock::now();
+    cv::Matx33d R;
+    cv::Rodrigues(toVec3d(rvec), R);
+    const cv::Vec3d t = toVec3d(tvec);
+    CameraIntrinsics intrinsics;
+    bool fastPath = makeCameraIntrinsics(cameraMatrix, distCoeffs, intrinsics);
+    cull(frame.size(), R, t, intrinsics);
+    Clock::time_point t1 = Clock::now();
+
+    double projectMs = 0.0, drawMs = 0.0;
+    for (size_t k = 0; k < visible.size(); ++k) {
+        const SceneInstance& instance = sceneInstances[visible[k]];
+        const Mesh& mesh = sceneModels[instance.model].levels[visibleLevel[k]];
+        const size_t n = mesh.vertexCount();
+
+        // Fold the instance placement into the camera pose so each vertex is transformed once
+        Clock::time_point p0 = Clock::now();
+        cv::Matx33d M = R * cv::Matx33d(instance.rotation) * double(instance.scale);
+        cv::Vec3d mt = R * cv::Vec3d(instance.translation) + t;
+        projected.resize(n);
+        if (fastPath) {
+            projectPointsSoA(mesh.px.data(), mesh.py.data(), mesh.pz.data(), n, M, mt, intrinsics, projected.data());
+        }
+        else {
+            cameraPoints.resize(n);
+            for (size_t v = 0; v < n; ++v) {
+                cv::Vec3d p = M * cv::Vec3d(mesh.px[v], mesh.py[v], mesh.pz[v]) + mt;
+                cameraPoints[v] = cv::Point3f(float(p[0]), float(p[1]), float(p[2]));
+            }
+            cv::projectPoints(cameraPoints, cv::Vec3d(), cv::Vec3d(), cameraMatrix, distCoeffs, projected);
+        }
+        Clock::time_point p1 = Clock::now();
+
+        if (drawVertices) {
+            for (const cv::Point2f& point : projected) {
+                cv::circle(frame, point, 2, cv::Scalar(0, 255, 0), -1);  // Green dot at each projected vertex
+            }
+        }
+        for (size_t e = 0; e < mesh.edges.size(); e += 2) {
+            cv::line(frame, projected[mesh.edges[e]], projected[mesh.edges[e + 1]], cv::Scalar(255, 0, 0), 1);  // Each shared edge once, in blue
+        }
+        projectMs += elapsedMs(p0, p1);
+        drawMs += elapsedMs(p1, Clock::now());
+        sceneStats.verticesProjected += int64_t(n);
+    }
+
+    sceneStats.cullMs += elapsedMs(t0, t1);
+    sceneStats.projectMs += projectMs;
+    sceneStats.drawMs += drawMs;
+    sceneStats.lastProjectMs = projectMs;
+}
+
+void Scene::drawSolid(cv::Mat& frame, SoftwareRasterizer& rasterizer, const cv::Mat& rvec, const cv::Mat& tvec,
+    const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs) {
+    PROFILE_SCOPE("drawSceneSolid");
+    Clock::time_point t0 = Clock::now();
+    cv::Matx33d R;
+    cv::Rodrigues(toVec3d(rvec), R);
+    CameraIntrinsics intrinsics;
+    makeCameraIntrinsics(cameraMatrix, distCoeffs, intrinsics);
+    cull(frame.size(), R, toVec3d(tvec), intrinsics);
+    Clock::time_point t1 = Clock::now();
+
+    // All visible instances go to the rasterizer together so they share one depth buffer
+    rasterInstances.clear();
+    for (size_t k = 0; k < visible.size(); ++k) {
+        const SceneInstance& instance = sceneInstances[visible[k]];
+        RasterInstance raster;
+        raster.mesh = &sceneModels[instance.model].levels[visibleLevel[k]];
+        raster.placement = cv::Matx33d(instance.rotation) * double(instance.scale);
+        raster.translation = cv::Vec3d(instance.translation);
+        rasterInstances.push_back(raster);
+        sceneStats.verticesProjected += int64_t(raster.mesh->vertexCount());
+    }
+    rasterizer.render(frame, rasterInstances, rvec, tvec, cameraMatrix, distCoeffs);
+
+    // The rasterizer's setup covers the vertex transform and projection; binning and tiles are the drawing
+    const RasterStats& raster = rasterizer.stats();
+    sceneStats.cullMs += elapsedMs(t0, t1);
+    sceneStats.projectMs += raster.setupMs;
+    sceneStats.drawMs += raster.binMs + raster.rasterMs;
+    sceneStats.lastProjectMs = raster.setupMs;
+}
+
+void printSceneStats(const SceneStats& stats, size_t instanceCount) {
+    if (stats.frames == 0) {
+        return;
+    }
+    double frames = double(stats.frames);
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Scene: " << instanceCount << " instances, " << stats.instancesVisible / frames << " visible per frame ("
+        << 100.0 * (stats.instancesTested - stats.instancesVisible) / std::max<int64_t>(stats.instancesTested, 1) << "% culled), "
+        << stats.verticesProjected / frames << " vertices projected per frame" << std::endl;
+    std::cout << "  cull mean " << stats.cullMs / frames << " ms, projection mean " << stats.projectMs / frames
+        << " ms, drawing mean " << stats.drawMs / frames << " ms over " << stats.frames << " frames" << std::endl;
+    if (stats.levelDraws.size() > 1) {
+        std::cout << "  instances drawn per level of detail:";
+        for (size_t level = 0; level < stats.levelDraws.size(); ++level) {
+            std::cout << " " << level << ": " << stats.levelDraws[level];
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "ModelLoader.h"
+#include "VertexProjector.h"
+#include "SoftwareRasterizer.h"
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// A model loaded once and shared by every instance that uses it
+struct SceneModel {
+    std::string name;
+    std::vector<Mesh> levels;              // Triangulated levels of detail; levels[0] is the full mesh
+    std::vector<size_t> levelTriangles;    // Triangles in each level
+    cv::Vec3f boundsCenter;                // Bounding sphere in model coordinates, covering every level
+    float boundsRadius = 0.0f;
+};
+
+// One placement of a model on the board: model point p maps to rotation * scale * p + translation (board units)
+struct SceneInstance {
+    int model = 0;
+    cv::Matx33f rotation = cv::Matx33f::eye();
+    cv::Vec3f translation;
+    float scale = 1.0f;
+};
+
+// Per-frame culling and drawing counters accumulated over all drawn frames
+struct SceneStats {
+    int64_t frames = 0;
+    int64_t instancesTested = 0;
+    int64_t instancesVisible = 0;
+    int64_t verticesProjected = 0;
+    double cullMs = 0.0, projectMs = 0.0, drawMs = 0.0;  // Totals
+    double lastProjectMs = 0.0;                           // Last frame only
+    std::vector<int64_t> levelDraws;                      // Instances drawn at each level of detail
+};
+
+// Bounding sphere of a mesh: the centre of its bounding box and the largest distance from it
+void meshBoundingSphere(const Mesh& mesh, cv::Vec3f& center, float& radius);
+
+// Several models placed any number of times on the board. Every instance's bounding sphere is tested
+// against the camera frustum before any of its vertices are projected.
+class Scene {
+public:
+    // Load an OBJ and its cached levels of detail once; returns the model index or -1
+    int addModel(const std::string& name, const std::string& path);
+
+    // Index of a model by name, -1 if it was never added
+    int findModel(const std::string& name) const;
+
+    // Place a model at a board position, turned by yaw degrees about the board normal and scaled uniformly
+    void addInstance(int model, const cv::Vec3f& position, float yawDegrees = 0.0f, float scale = 1.0f);
+
+    // Read a scene description. Each line is one of
+    //   model <name> <obj path>                          (relative paths start at the scene file's folder)
+    //   instance <name> <x> <y> <z> [yaw] [scale]
+    //   grid <name> <columns> <rows> <spacing> [scale]   (instances spread from the board origin)
+    // Lines starting with '#' are ignored.
+    bool load(const std::string& path);
+
+    // Cull, project and draw every visible instance as a wireframe over the frame. Each instance uses the
+    // coarsest level of detail that still has about one triangle per lodPixelsPerTriangle of its on-screen area.
+    void draw(cv::Mat& frame, const cv::Mat& rvec, const cv::Mat& tvec, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs);
+
+    // The same culling and level selection, with the visible instances drawn filled by the rasterizer
+    void drawSolid(cv::Mat& frame, SoftwareRasterizer& rasterizer, const cv::Mat& rvec, const cv::Mat& tvec,
+        const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs);
+
+    const std::vector<SceneModel>& models() const { return sceneModels; }
+    const std::vector<SceneInstance>& instances() const { return sceneInstances; }
+    const SceneStats& stats() const { return sceneStats; }
+
+    float cullMargin = 0.1f;    // Extra border around the image, as a fraction of its size, for distortion
+    float nearPlane = 0.01f;    // Board units in front of the camera
+    bool drawVertices = true;   // Also mark every projected vertex
+    bool useLod = true;         // Otherwise always draw the full mesh
+    float lodPixelsPerTriangle = 64.0f;
+
+private:
+    // Fill visible and visibleLevel with the instances inside the frustum and the level each one is drawn at
+    void cull(const cv::Size& imageSize, const cv::Matx33d& R, const cv::Vec3d& t, const CameraIntrinsics& intrinsics);
+
+    std::vector<SceneModel> sceneModels;
+    std::vector<SceneInstance> sceneInstances;
+    std::vector<int> visible, visibleLevel;
+    std::vector<cv::Point2f> projected;
+    std::vector<cv::Point3f> cameraPoints;  // Only used for distortion models projectPointsSoA does not cover
+    std::vector<RasterInstance> rasterInstances;
+    SceneStats sceneStats;
+};
+
+void printSceneStats(const SceneStats& stats, size_t instanceCount);
@@ -0,0 +1,241 @@
+#include "SoftwareRasterizer.h"
+#include "Profiler.h"
+#include "Timing.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+inline float edgeFunction(const cv::Point2f& a, const cv::Point2f& b, float px, float py) {
+    return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+} // namespace
+
+void SoftwareRasterizer::render(cv::Mat& frame, const std::vector<RasterInstance>& instances, const cv::Mat& rvec, const cv::Mat& tvec,
+    const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs) {
+    PROFILE_SCOPE("rasterize");
+    Clock::time_point t0 = Clock::now();
+    cv::Matx33d R;
+    cv::Rodrigues(toVec3d(rvec), R);
+    const cv::Vec3d t = toVec3d(tvec);
+    CameraIntrinsics intrinsics;
+    bool fastPath = makeCameraIntrinsics(cameraMatrix, distCoeffs, intrinsics);
+
+    size_t vertexTotal = 0;
+    for (const RasterInstance& instance : instances) {
+        vertexTotal += instance.mesh->vertexCount();
+    }
+    camX.resize(vertexTotal);
+    camY.resize(vertexTotal);
+    camZ.resize(vertexTotal);
+    screen.resize(vertexTotal);
+    visibleCorners.clear();
+    cornerShade.clear();
+
+    int triangleTotal = 0, culled = 0;
+    size_t base = 0;
+    for (const RasterInstance& instance : instances) {
+        const Mesh& mesh = *instance.mesh;
+        const size_t vertexCount = mesh.vertexCount();
+        const size_t triangleCount = mesh.faceCount();
+        triangleTotal += int(triangleCount);
+
+        // Vertex stage: the placement is folded into the pose so each vertex is transformed once
+        cv::Matx33d M = R * instance.placement;
+        cv::Vec3d mt = R * instance.translation + t;
+        for (size_t i = 0; i < vertexCount; ++i) {
+            float x = mesh.px[i], y = mesh.py[i], z = mesh.pz[i];
+            camX[base + i] = float(M(0, 0) * x + M(0, 1) * y + M(0, 2) * z + mt[0]);
+            camY[base + i] = float(M(1, 0) * x + M(1, 1) * y + M(1, 2) * z + mt[1]);
+            camZ[base + i] = float(M(2, 0) * x + M(2, 1) * y + M(2, 2) * z + mt[2]);
+        }
+        if (fastPath) {
+            projectPointsSoA(mesh.px.data(), mesh.py.data(), mesh.pz.data(), vertexCount, M, mt, intrinsics, screen.data() + base);
+        }
+        else if (vertexCount > 0) {
+            cameraPoints.resize(vertexCount);
+            for (size_t i = 0; i < vertexCount; ++i) {
+                cameraPoints[i] = cv::Point3f(camX[base + i], camY[base + i], camZ[base + i]);
+            }
+            cv::Mat out(int(vertexCount), 1, CV_32FC2, screen.data() + base);
+            cv::projectPoints(cameraPoints, cv::Vec3d(), cv::Vec3d(), cameraMatrix, distCoeffs, out);
+        }
+
+        // Headlight shading: intensity is how directly a normal faces the camera
+        normalShade.resize(mesh.nx.size());
+        for (size_t i = 0; i < normalShade.size(); ++i) {
+            cv::Vec3d n = M * cv::Vec3d(mesh.nx[i], mesh.ny[i], mesh.nz[i]);
+            double length = cv::norm(n);
+            normalShade[i] = length > 0.0 ? float(std::max(0.0, -n[2] / length)) : 1.0f;
+        }
+
+        for (size_t f = 0; f < triangleCount; ++f) {
+            const int32_t* corner = &mesh.cornerVertices[3 * f];
+            int a = int(base) + corner[0], b = int(base) + corner[1], c = int(base) + corner[2];
+            if (camZ[a] < nearPlane || camZ[b] < nearPlane || camZ[c] < nearPlane) {
+                culled++;
+                continue;
+            }
+
+            // Face normal from the camera-space edges; facing the camera when it points against the view ray
+            float ux = camX[b] - camX[a], uy = camY[b] - camY[a], uz = camZ[b] - camZ[a];
+            float vx = camX[c] - camX[a], vy = camY[c] - camY[a], vz = camZ[c] - camZ[a];
+            float nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+            float facing = nx * camX[a] + ny * camY[a] + nz * camZ[a];
+            if (cullBackFaces && facing >= 0.0f) {
+                culled++;
+                continue;
+            }
+
+            float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+            float flatShade = length > 0.0f ? std::abs(nz) / length : 1.0f;
+            for (int k = 0; k < 3; ++k) {
+                int32_t normal = mesh.cornerNormals[3 * f + k];
+                bool useNormal = shading == ShadingMode::Gouraud && normal >= 0 && normal < int32_t(normalShade.size());
+                visibleCorners.push_back(int32_t(base) + corner[k]);
+                cornerShade.push_back(ambient + (1.0f - ambient) * (useNormal ? normalShade[normal] : flatShade));
+            }
+        }
+        base += vertexCount;
+    }
+    const size_t visibleCount = visibleCorners.size() / 3;
+    Clock::time_point t1 = Clock::now();
+
+    // Binning: add each visible triangle to every tile its bounding box touches
+    const int tilesX = (frame.cols + tileSize - 1) / tileSize;
+    const int tilesY = (frame.rows + tileSize - 1) / tileSize;
+    if (tilesX != rasterStats.tilesX || tilesY != rasterStats.tilesY) {
+        rasterStats.tilesX = tilesX;
+        rasterStats.tilesY = tilesY;
+        rasterStats.tileTotalMs.assign(size_t(tilesX) * tilesY, 0.0);
+        rasterStats.tileFrames.assign(size_t(tilesX) * tilesY, 0);
+        bins.assign(size_t(tilesX) * tilesY, std::vector<int>());
+    }
+    for (std::vector<int>& bin : bins) {
+        bin.clear();
+    }
+    int binned = 0;
+    for (size_t f = 0; f < visibleCount; ++f) {
+        const int32_t* corner = &visibleCorners[3 * f];
+        const cv::Point2f& a = screen[corner[0]];
+        const cv::Point2f& b = screen[corner[1]];
+        const cv::Point2f& c = screen[corner[2]];
+        float minX = std::min({ a.x, b.x, c.x }), maxX = std::max({ a.x, b.x, c.x });
+        float minY = std::min({ a.y, b.y, c.y }), maxY = std::max({ a.y, b.y, c.y });
+        if (maxX < 0.0f || maxY < 0.0f || minX >= frame.cols || minY >= frame.rows) continue;
+        int tx0 = std::max(0, int(minX) / tileSize), tx1 = std::min(tilesX - 1, int(maxX) / tileSize);
+        int ty0 = std::max(0, int(minY) / tileSize), ty1 = std::min(tilesY - 1, int(maxY) / tileSize);
+        for (int ty = ty0; ty <= ty1; ++ty) {
+            for (int tx = tx0; tx <= tx1; ++tx) {
+                bins[size_t(ty) * tilesX + tx].push_back(int(f));
+                binned++;
+            }
+        }
+    }
+    activeTiles.clear();
+    for (size_t i = 0; i < bins.size(); ++i) {
+        if (!bins[i].empty()) activeTiles.push_back(int(i));
+    }
+    Clock::time_point t2 = Clock::now();
+
+    // Tiles cover disjoint pixels, so they can be rasterized and composited concurrently
+    depthBuffer.create(frame.rows, frame.cols, CV_32F);
+    std::vector<double>& tileTotalMs = rasterStats.tileTotalMs;
+    std::vector<int64_t>& tileFrames = rasterStats.tileFrames;
+    cv::parallel_for_(cv::Range(0, int(activeTiles.size())), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            Clock::time_point start = Clock::now();
+            rasterizeTile(activeTiles[i], frame);
+            tileTotalMs[activeTiles[i]] += elapsedMs(start, Clock::now());
+            tileFrames[activeTiles[i]]++;
+        }
+    });
+    Clock::time_point t3 = Clock::now();
+
+    rasterStats.frames++;
+    rasterStats.trianglesIn = triangleTotal;
+    rasterStats.trianglesCulled = culled;
+    rasterStats.trianglesBinned = binned;
+    rasterStats.setupMs = elapsedMs(t0, t1);
+    rasterStats.binMs = elapsedMs(t1, t2);
+    rasterStats.rasterMs = elapsedMs(t2, t3);
+}
+
+void SoftwareRasterizer::rasterizeTile(int tile, cv::Mat& frame) {
+    const int tilesX = rasterStats.tilesX;
+    const int x0 = (tile % tilesX) * tileSize, y0 = (tile / tilesX) * tileSize;
+    const int x1 = std::min(x0 + tileSize, frame.cols), y1 = std::min(y0 + tileSize, frame.rows);
+
+    for (int y = y0; y < y1; ++y) {
+        std::fill(depthBuffer.ptr<float>(y) + x0, depthBuffer.ptr<float>(y) + x1, 0.0f);
+    }
+
+    for (int f : bins[tile]) {
+        const int32_t* corner = &visibleCorners[3 * f];
+        const cv::Point2f& a = screen[corner[0]];
+        const cv::Point2f& b = screen[corner[1]];
+        const cv::Point2f& c = screen[corner[2]];
+        float area = edgeFunction(a, b, c.x, c.y);
+        if (std::abs(area) < 1e-6f) continue;
+        float invArea = 1.0f / area;
+
+        // 1/z varies linearly across the screen, so it is used for the depth test
+        float iza = 1.0f / camZ[corner[0]], izb = 1.0f / camZ[corner[1]], izc = 1.0f / camZ[corner[2]];
+        float sa = cornerShade[3 * f], sb = cornerShade[3 * f + 1], sc = cornerShade[3 * f + 2];
+
+        int minX = std::max(x0, int(std::floor(std::min({ a.x, b.x, c.x }))));
+        int maxX = std::min(x1 - 1, int(std::ceil(std::max({ a.x, b.x, c.x }))));
+        int minY = std::max(y0, int(std::floor(std::min({ a.y, b.y, c.y }))));
+        int maxY = std::min(y1 - 1, int(std::ceil(std::max({ a.y, b.y, c.y }))));
+
+        for (int y = minY; y <= maxY; ++y) {
+            float* depthRow = depthBuffer.ptr<float>(y);
+            cv::Vec3b* colorRow = frame.ptr<cv::Vec3b>(y);
+            float py = y + 0.5f;
+            for (int x = minX; x <= maxX; ++x) {
+                float px = x + 0.5f;
+                float wa = edgeFunction(b, c, px, py) * invArea;
+                float wb = edgeFunction(c, a, px, py) * invArea;
+                float wc = 1.0f - wa - wb;
+                if (wa < 0.0f || wb < 0.0f || wc < 0.0f) continue;
+
+                float invZ = wa * iza + wb * izb + wc * izc;
+                if (invZ <= depthRow[x]) continue;
+                depthRow[x] = invZ;
+
+                float shade = wa * sa + wb * sb + wc * sc;
+                colorRow[x] = cv::Vec3b(cv::saturate_cast<uchar>(color[0] * shade),
+                    cv::saturate_cast<uchar>(color[1] * shade), cv::saturate_cast<uchar>(color[2] * shade));
+            }
+        }
+    }
+}
+
+void printRasterStats(const RasterStats& stats) {
+    if (stats.frames == 0) {
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Rasterizer: " << stats.frames << " frames; last frame " << stats.trianglesIn << " triangles, "
+        << stats.trianglesCulled << " culled, " << stats.trianglesBinned << " tile bins; setup " << stats.setupMs
+        << " ms, binning " << stats.binMs << " ms, tiles " << stats.rasterMs << " ms" << std::endl;
+
+    // Mean time of each tile over the frames in which it had triangles
+    std::cout << "  mean tile time (ms), " << stats.tilesX << "x" << stats.tilesY << " tiles:" << std::endl;
+    for (int ty = 0; ty < stats.tilesY; ++ty) {
+        std::cout << "  ";
+        for (int tx = 0; tx < stats.tilesX; ++tx) {
+            size_t i = size_t(ty) * stats.tilesX + tx;
+            double mean = stats.tileFrames[i] > 0 ? stats.tileTotalMs[i] / stats.tileFrames[i] : 0.0;
+            std::cout << std::setw(6) << mean;
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
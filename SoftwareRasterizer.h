@@ -0,0 +1,69 @@
+#pragma once
+#include "ModelLoader.h"
+#include "VertexProjector.h"
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstdint>
+
+enum class ShadingMode {
+    Flat,     // One intensity per triangle from its face normal
+    Gouraud   // Intensities from the OBJ vertex normals, interpolated across the triangle
+};
+
+// Timing of one rendered frame plus per-tile totals accumulated over all frames
+struct RasterStats {
+    int64_t frames = 0;
+    int trianglesIn = 0;        // Last frame: triangles in all instances
+    int trianglesCulled = 0;    // Last frame: back-facing or behind the camera
+    int trianglesBinned = 0;    // Last frame: triangle/tile pairs after binning
+    double setupMs = 0.0;       // Last frame: vertex transform, projection and shading
+    double binMs = 0.0;         // Last frame: assigning triangles to tiles
+    double rasterMs = 0.0;      // Last frame: parallel tile rasterization and compositing
+    int tilesX = 0, tilesY = 0;
+    std::vector<double> tileTotalMs;     // Accumulated rasterization time of each tile
+    std::vector<int64_t> tileFrames;     // Frames in which each tile had work
+};
+
+// One triangle mesh to rasterize and its placement on the board: model point p maps to placement * p + translation
+struct RasterInstance {
+    const Mesh* mesh = nullptr;    // Triangle faces only
+    cv::Matx33d placement = cv::Matx33d::eye();  // Rotation and uniform scale
+    cv::Vec3d translation;
+};
+
+// CPU rasterizer that draws filled, depth-tested and shaded meshes over the camera frame.
+// The image is split into square tiles; triangles are binned per tile and tiles are rasterized in parallel.
+// All instances of one call share the depth buffer, so they hide each other correctly.
+class SoftwareRasterizer {
+public:
+    // Draw every instance for the board pose. The meshes must be triangulated (see triangulateMesh).
+    void render(cv::Mat& frame, const std::vector<RasterInstance>& instances, const cv::Mat& rvec, const cv::Mat& tvec,
+        const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs);
+
+    const RasterStats& stats() const { return rasterStats; }
+
+    ShadingMode shading = ShadingMode::Gouraud;
+    cv::Vec3f color = cv::Vec3f(60.0f, 170.0f, 60.0f);  // BGR base color
+    float ambient = 0.25f;
+    int tileSize = 64;
+    bool cullBackFaces = true;
+    float nearPlane = 0.01f;  // Triangles with a vertex closer than this (board units) are skipped
+
+private:
+    void rasterizeTile(int tile, cv::Mat& frame);
+
+    // Per-frame buffers over the vertices and visible triangles of all instances together
+    std::vector<float> camX, camY, camZ;      // Camera-space vertex positions
+    std::vector<cv::Point2f> screen;          // Image positions of the vertices
+    std::vector<cv::Point3f> cameraPoints;    // Only used for distortion models projectPointsSoA does not cover
+    std::vector<float> normalShade;           // Intensity of each OBJ normal of the current instance
+    std::vector<int32_t> visibleCorners;      // Vertex indices of each visible triangle, 3 per triangle
+    std::vector<float> cornerShade;           // Intensity at each visible triangle corner
+    std::vector<std::vector<int>> bins;       // Visible triangle indices overlapping each tile
+    std::vector<int> activeTiles;
+    cv::Mat depthBuffer;                      // 1/z per pixel, 0 where nothing was drawn
+    RasterStats rasterStats;
+};
+
+// Print the last frame's breakdown and a grid of mean per-tile rasterization times
+void printRasterStats(const RasterStats& stats);
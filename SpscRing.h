@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// Bounded single-producer single-consumer ring of preallocated slots, without locks.
+// Slots are filled and read in place, so buffers inside them (e.g. a cv::Mat) are reused from lap to lap.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : slots(capacity > 0 ? capacity : 1) {}
+
+    // Producer: the slot to fill next, or nullptr while the ring is full
+    T* beginPush() {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == slots.size()) {
+            return nullptr;
+        }
+        return &slots[tail % slots.size()];
+    }
+
+    // Producer: publish the slot returned by beginPush
+    void endPush() {
+        tailIndex.store(tailIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: the oldest filled slot, or nullptr while the ring is empty
+    T* front() {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots[head % slots.size()];
+    }
+
+    // Consumer: hand the slot returned by front back to the producer
+    void pop() {
+        headIndex.store(headIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Filled slots; exact only when called from the producer or the consumer
+    size_t size() const {
+        return tailIndex.load(std::memory_order_acquire) - headIndex.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return slots.size(); }
+
+private:
+    std::vector<T> slots;
+    alignas(64) std::atomic<size_t> headIndex{0};  // Written by the consumer only
+    alignas(64) std::atomic<size_t> tailIndex{0};  // Written by the producer only
+};
@@ -0,0 +1,7 @@
+#pragma once
+#include <chrono>
+
+// Milliseconds between two steady-clock readings
+inline double elapsedMs(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
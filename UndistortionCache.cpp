@@ -0,0 +1,188 @@
+#include "UndistortionCache.h"
+#include "Profiler.h"
+#include "MappedFile.h"
+#include "Timing.h"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Map file layout: header, then map1 (2 x int16 per pixel) and map2 (uint16 per pixel), row by row
+const char mapMagic[4] = { 'A', 'R', 'U', 'M' };
+const uint32_t mapVersion = 1;
+const int maxDistCoeffs = 14;
+
+struct MapHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t distCount;
+    uint32_t reserved;
+    double cameraMatrix[9];
+    double distCoeffs[maxDistCoeffs];
+};
+
+// Compare a calibration matrix against its stored CV_64F key in place; this runs every frame, so nothing is converted
+bool equalsKey(const cv::Mat& values, const cv::Mat& key) {
+    if (!values.isContinuous() || (values.depth() != CV_64F && values.depth() != CV_32F)) {
+        return false;
+    }
+    size_t count = values.total() * values.channels();
+    const double* expected = key.ptr<double>();
+    if (values.depth() == CV_64F) {
+        return std::equal(values.ptr<double>(), values.ptr<double>() + count, expected);
+    }
+    const float* p = values.ptr<float>();
+    for (size_t i = 0; i < count; ++i) {
+        if (double(p[i]) != expected[i]) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool UndistortionCache::matches(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Size imageSize) const {
+    if (map1.empty() || imageSize != keySize || distCoeffs.total() != keyDistCoeffs.total()) {
+        return false;
+    }
+    return equalsKey(cameraMatrix, keyCameraMatrix) && (distCoeffs.empty() || equalsKey(distCoeffs, keyDistCoeffs));
+}
+
+bool UndistortionCache::update(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Size imageSize, const std::string& mapPath) {
+    if (cameraMatrix.total() != 9 || distCoeffs.total() > size_t(maxDistCoeffs) || imageSize.area() == 0) {
+        return false;
+    }
+    if (matches(cameraMatrix, distCoeffs, imageSize)) {
+        return true;
+    }
+
+    cameraMatrix.reshape(1, 3).convertTo(keyCameraMatrix, CV_64F);
+    if (distCoeffs.empty()) keyDistCoeffs.release();
+    else distCoeffs.reshape(1, int(distCoeffs.total())).convertTo(keyDistCoeffs, CV_64F);
+    keySize = imageSize;
+    map1.release();
+    map2.release();
+
+    if (!mapPath.empty() && loadMaps(mapPath)) {
+        undistortStats.mapsLoaded++;
+        return true;
+    }
+
+    Clock::time_point start = Clock::now();
+    cv::initUndistortRectifyMap(keyCameraMatrix, keyDistCoeffs, cv::Mat(), keyCameraMatrix, imageSize, CV_16SC2, map1, map2);
+    undistortStats.lastBuildMs = elapsedMs(start, Clock::now());
+    undistortStats.rebuilds++;
+
+    if (!mapPath.empty() && !saveMaps(mapPath)) {
+        std::cerr << "Warning: could not write undistortion map " << mapPath << std::endl;
+    }
+    return true;
+}
+
+void UndistortionCache::apply(const cv::Mat& src, cv::Mat& dst) {
+    PROFILE_SCOPE("undistort");
+    if (map1.empty() || src.size() != keySize) {
+        src.copyTo(dst);
+        return;
+    }
+    Clock::time_point start = Clock::now();
+    dst.create(src.size(), src.type());
+
+    // Every band reads the source anywhere but writes only its own rows, so the bands never overlap
+    int bands = (src.rows + bandRows - 1) / std::max(bandRows, 1);
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        for (int band = range.start; band < range.end; ++band) {
+            int rowStart = band * bandRows, rowEnd = std::min(rowStart + bandRows, src.rows);
+            cv::Mat dstBand = dst.rowRange(rowStart, rowEnd);
+            cv::remap(src, dstBand, map1.rowRange(rowStart, rowEnd), map2.rowRange(rowStart, rowEnd), cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+        }
+    });
+
+    double ms = elapsedMs(start, Clock::now());
+    undistortStats.frames++;
+    undistortStats.remapTotalMs += ms;
+    undistortStats.remapMaxMs = std::max(undistortStats.remapMaxMs, ms);
+}
+
+bool UndistortionCache::loadMaps(const std::string& path) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(MapHeader)) {
+        return false;
+    }
+    MapHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, mapMagic, sizeof(mapMagic)) != 0 || header.version != mapVersion) {
+        return false;
+    }
+
+    // The stored key must be the calibration we were asked for, bit for bit
+    if (int(header.width) != keySize.width || int(header.height) != keySize.height || header.distCount != keyDistCoeffs.total()
+        || std::memcmp(header.cameraMatrix, keyCameraMatrix.ptr<double>(), sizeof(header.cameraMatrix)) != 0
+        || (header.distCount > 0 && std::memcmp(header.distCoeffs, keyDistCoeffs.ptr<double>(), header.distCount * sizeof(double)) != 0)) {
+        return false;
+    }
+
+    size_t pixels = size_t(keySize.area());
+    if (file.size() != sizeof(header) + pixels * (2 * sizeof(int16_t) + sizeof(uint16_t))) {
+        return false;
+    }
+    const char* p = file.data() + sizeof(header);
+    map1.create(keySize, CV_16SC2);
+    map2.create(keySize, CV_16UC1);
+    std::memcpy(map1.ptr<int16_t>(), p, pixels * 2 * sizeof(int16_t));
+    std::memcpy(map2.ptr<uint16_t>(), p + pixels * 2 * sizeof(int16_t), pixels * sizeof(uint16_t));
+    return true;
+}
+
+bool UndistortionCache::saveMaps(const std::string& path) const {
+    MapHeader header{};
+    std::memcpy(header.magic, mapMagic, sizeof(header.magic));
+    header.version = mapVersion;
+    header.width = uint32_t(keySize.width);
+    header.height = uint32_t(keySize.height);
+    header.distCount = uint32_t(keyDistCoeffs.total());
+    std::memcpy(header.cameraMatrix, keyCameraMatrix.ptr<double>(), sizeof(header.cameraMatrix));
+    if (header.distCount > 0) {
+        std::memcpy(header.distCoeffs, keyDistCoeffs.ptr<double>(), header.distCount * sizeof(double));
+    }
+
+    // Write next to the final path and rename so a crash never leaves a half-written map
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (int y = 0; y < map1.rows; ++y) {
+            out.write(reinterpret_cast<const char*>(map1.ptr<int16_t>(y)), map1.cols * 2 * sizeof(int16_t));
+        }
+        for (int y = 0; y < map2.rows; ++y) {
+            out.write(reinterpret_cast<const char*>(map2.ptr<uint16_t>(y)), map2.cols * sizeof(uint16_t));
+        }
+        if (!out.good()) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    return !error;
+}
+
+void printUndistortStats(const UndistortStats& stats) {
+    if (stats.frames == 0) {
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "[undistort] " << stats.frames << " frames, remap mean " << stats.remapMeanMs() << " ms (max " << stats.remapMaxMs
+        << "), maps built " << stats.rebuilds << " times (last " << stats.lastBuildMs << " ms), loaded " << stats.mapsLoaded << " times" << std::endl;
+    std::cout << std::defaultfloat;
+}
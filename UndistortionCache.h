@@ -0,0 +1,46 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <cstdint>
+
+struct UndistortStats {
+    int64_t rebuilds = 0;       // Maps computed with initUndistortRectifyMap
+    int64_t mapsLoaded = 0;     // Maps read back from the map file instead
+    double lastBuildMs = 0.0;
+    int64_t frames = 0;
+    double remapTotalMs = 0.0;
+    double remapMaxMs = 0.0;
+
+    double remapMeanMs() const { return frames > 0 ? remapTotalMs / frames : 0.0; }
+};
+
+// Undistortion maps for one calibration and resolution in OpenCV's fixed-point form
+// (CV_16SC2 integer coordinates plus CV_16UC1 interpolation weights).
+// The maps keep the original camera matrix, so undistorted frames use the same K with no distortion.
+class UndistortionCache {
+public:
+    // Make the maps match this calibration and frame size. They are only rebuilt when one of them
+    // changed; a non-empty mapPath is tried first and rewritten after a rebuild. Returns false if unusable.
+    bool update(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Size imageSize, const std::string& mapPath = std::string());
+
+    // Undistort src into dst, splitting the rows into bands that are remapped in parallel
+    void apply(const cv::Mat& src, cv::Mat& dst);
+
+    bool valid() const { return !map1.empty(); }
+    const UndistortStats& stats() const { return undistortStats; }
+
+    int bandRows = 32;  // Rows per parallel band
+
+private:
+    bool matches(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, cv::Size imageSize) const;
+    bool loadMaps(const std::string& path);
+    bool saveMaps(const std::string& path) const;
+
+    cv::Mat map1, map2;
+    cv::Mat keyCameraMatrix, keyDistCoeffs;  // Calibration the maps were built for, CV_64F
+    cv::Size keySize;
+    UndistortStats undistortStats;
+};
+
+// Print map rebuilds and the per-frame remap cost
+void printUndistortStats(const UndistortStats& stats);
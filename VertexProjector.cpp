@@ -0,0 +1,166 @@
+#include "VertexProjector.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+bool CameraIntrinsics::operator==(const CameraIntrinsics& other) const {
+    return fx == other.fx && fy == other.fy && cx == other.cx && cy == other.cy &&
+        k1 == other.k1 && k2 == other.k2 && p1 == other.p1 && p2 == other.p2 &&
+        k3 == other.k3 && k4 == other.k4 && k5 == other.k5 && k6 == other.k6;
+}
+
+bool makeCameraIntrinsics(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, CameraIntrinsics& intrinsics) {
+    cv::Matx33d K;
+    cameraMatrix.convertTo(K, CV_64F);
+    intrinsics = CameraIntrinsics();
+    intrinsics.fx = float(K(0, 0));
+    intrinsics.fy = float(K(1, 1));
+    intrinsics.cx = float(K(0, 2));
+    intrinsics.cy = float(K(1, 2));
+
+    size_t n = distCoeffs.empty() ? 0 : distCoeffs.total();
+    if (n != 0 && n != 4 && n != 5 && n != 8) {
+        return false;
+    }
+    double k[8] = { 0 };
+    for (size_t i = 0; i < n; ++i) {
+        k[i] = distCoeffs.depth() == CV_32F ? distCoeffs.at<float>(int(i)) : distCoeffs.at<double>(int(i));
+    }
+    intrinsics.k1 = float(k[0]);
+    intrinsics.k2 = float(k[1]);
+    intrinsics.p1 = float(k[2]);
+    intrinsics.p2 = float(k[3]);
+    intrinsics.k3 = float(k[4]);
+    intrinsics.k4 = float(k[5]);
+    intrinsics.k5 = float(k[6]);
+    intrinsics.k6 = float(k[7]);
+    intrinsics.hasDistortion = std::any_of(k, k + 8, [](double c) { return c != 0.0; });
+    return true;
+}
+
+cv::Vec3d toVec3d(const cv::Mat& m) {
+    if (m.depth() == CV_32F) {
+        return cv::Vec3d(m.at<float>(0), m.at<float>(1), m.at<float>(2));
+    }
+    return cv::Vec3d(m.at<double>(0), m.at<double>(1), m.at<double>(2));
+}
+
+void projectPointsSoA(const float* xs, const float* ys, const float* zs, size_t n,
+    const cv::Matx33d& R, const cv::Vec3d& t, const CameraIntrinsics& c, cv::Point2f* out) {
+    const float r00 = float(R(0, 0)), r01 = float(R(0, 1)), r02 = float(R(0, 2));
+    const float r10 = float(R(1, 0)), r11 = float(R(1, 1)), r12 = float(R(1, 2));
+    const float r20 = float(R(2, 0)), r21 = float(R(2, 1)), r22 = float(R(2, 2));
+    const float t0 = float(t[0]), t1 = float(t[1]), t2 = float(t[2]);
+    float* uv = reinterpret_cast<float*>(out);
+
+    // The distortion test is hoisted out of the loop so each variant stays branch-free
+    if (!c.hasDistortion) {
+        for (size_t i = 0; i < n; ++i) {
+            float X = r00 * xs[i] + r01 * ys[i] + r02 * zs[i] + t0;
+            float Y = r10 * xs[i] + r11 * ys[i] + r12 * zs[i] + t1;
+            float Z = r20 * xs[i] + r21 * ys[i] + r22 * zs[i] + t2;
+            float invZ = Z != 0.0f ? 1.0f / Z : 1.0f;
+            uv[2 * i] = c.fx * X * invZ + c.cx;
+            uv[2 * i + 1] = c.fy * Y * invZ + c.cy;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        float X = r00 * xs[i] + r01 * ys[i] + r02 * zs[i] + t0;
+        float Y = r10 * xs[i] + r11 * ys[i] + r12 * zs[i] + t1;
+        float Z = r20 * xs[i] + r21 * ys[i] + r22 * zs[i] + t2;
+        float invZ = Z != 0.0f ? 1.0f / Z : 1.0f;
+        float x = X * invZ, y = Y * invZ;
+        float r2 = x * x + y * y;
+        float radial = (1.0f + r2 * (c.k1 + r2 * (c.k2 + r2 * c.k3))) / (1.0f + r2 * (c.k4 + r2 * (c.k5 + r2 * c.k6)));
+        float xd = x * radial + 2.0f * c.p1 * x * y + c.p2 * (r2 + 2.0f * x * x);
+        float yd = y * radial + c.p1 * (r2 + 2.0f * y * y) + 2.0f * c.p2 * x * y;
+        uv[2 * i] = c.fx * xd + c.cx;
+        uv[2 * i + 1] = c.fy * yd + c.cy;
+    }
+}
+
+void VertexProjector::setVertices(const std::vector<Vertex>& vertices) {
+    sharedMesh = nullptr;
+    count = vertices.size();
+    positions.resize(3 * count);
+    float* xs = positions.data();
+    float* ys = xs + count;
+    float* zs = ys + count;
+    for (size_t i = 0; i < count; ++i) {
+        xs[i] = vertices[i].x;
+        ys[i] = vertices[i].y;
+        zs[i] = vertices[i].z;
+    }
+    projected.resize(count);
+    fallbackPoints.clear();
+    cacheValid = false;
+}
+
+void VertexProjector::setVertices(const Mesh& mesh) {
+    // The mesh already stores x, y and z separately, so this is three block copies
+    sharedMesh = nullptr;
+    count = mesh.vertexCount();
+    positions.resize(3 * count);
+    std::copy(mesh.px.begin(), mesh.px.end(), positions.begin());
+    std::copy(mesh.py.begin(), mesh.py.end(), positions.begin() + count);
+    std::copy(mesh.pz.begin(), mesh.pz.end(), positions.begin() + 2 * count);
+    projected.resize(count);
+    fallbackPoints.clear();
+    cacheValid = false;
+}
+
+void VertexProjector::shareVertices(const Mesh& mesh) {
+    sharedMesh = &mesh;
+    count = mesh.vertexCount();
+    positions.clear();
+    positions.shrink_to_fit();
+    projected.resize(count);
+    fallbackPoints.clear();
+    cacheValid = false;
+}
+
+const std::vector<cv::Point2f>& VertexProjector::project(const cv::Mat& rvec, const cv::Mat& tvec, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs) {
+    PROFILE_SCOPE("projectModel");
+    cv::Vec3d r = toVec3d(rvec), t = toVec3d(tvec);
+    CameraIntrinsics intrinsics;
+    bool fastPath = makeCameraIntrinsics(cameraMatrix, distCoeffs, intrinsics);
+
+    // Skip the whole pass when neither the pose nor the camera moved
+    if (cacheValid && fastPath && intrinsics == lastIntrinsics &&
+        cv::norm(r - lastRvec, cv::NORM_INF) <= epsilon && cv::norm(t - lastTvec, cv::NORM_INF) <= epsilon) {
+        cacheHitCount++;
+        return projected;
+    }
+
+    if (fastPath) {
+        // One Rodrigues conversion per pose, then a single pass over every vertex
+        cv::Matx33d R;
+        cv::Rodrigues(r, R);
+        if (sharedMesh) {
+            projectPointsSoA(sharedMesh->px.data(), sharedMesh->py.data(), sharedMesh->pz.data(), count, R, t, intrinsics, projected.data());
+        }
+        else {
+            const float* xs = positions.data();
+            projectPointsSoA(xs, xs + count, xs + 2 * count, count, R, t, intrinsics, projected.data());
+        }
+    }
+    else {
+        if (fallbackPoints.size() != count) {
+            fallbackPoints.resize(count);
+            for (size_t i = 0; i < count; ++i) {
+                fallbackPoints[i] = sharedMesh ? cv::Point3f(sharedMesh->px[i], sharedMesh->py[i], sharedMesh->pz[i])
+                    : cv::Point3f(positions[i], positions[count + i], positions[2 * count + i]);
+            }
+        }
+        cv::projectPoints(fallbackPoints, r, t, cameraMatrix, distCoeffs, projected);
+    }
+
+    lastRvec = r;
+    lastTvec = t;
+    lastIntrinsics = intrinsics;
+    cacheValid = fastPath;
+    projectionCount++;
+    return projected;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "ModelLoader.h"
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstdint>
+
+// Pinhole intrinsics with the distortion terms OpenCV's projectPoints applies for up to 8 coefficients
+struct CameraIntrinsics {
+    float fx = 1.0f, fy = 1.0f, cx = 0.0f, cy = 0.0f;
+    float k1 = 0.0f, k2 = 0.0f, p1 = 0.0f, p2 = 0.0f, k3 = 0.0f, k4 = 0.0f, k5 = 0.0f, k6 = 0.0f;
+    bool hasDistortion = false;
+
+    bool operator==(const CameraIntrinsics& other) const;
+};
+
+// Fill intrinsics from a camera matrix and 0, 4, 5 or 8 distortion coefficients; returns false for other models
+bool makeCameraIntrinsics(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, CameraIntrinsics& intrinsics);
+
+// Read a 3-element rotation or translation vector stored as CV_32F or CV_64F
+cv::Vec3d toVec3d(const cv::Mat& m);
+
+// Project n points stored as separate x, y and z arrays with a fixed rotation and translation.
+// The loop has no per-point branches or allocations so the compiler can vectorize it.
+void projectPointsSoA(const float* xs, const float* ys, const float* zs, size_t n,
+    const cv::Matx33d& R, const cv::Vec3d& t, const CameraIntrinsics& intrinsics, cv::Point2f* out);
+
+// Projects a model's vertices for a pose, reusing its buffers and the previous result when the pose is unchanged
+class VertexProjector {
+public:
+    void setVertices(const std::vector<Vertex>& vertices);
+    void setVertices(const Mesh& mesh);
+
+    // Project the mesh's own position arrays without copying them, so several projectors can share one
+    // read-only mesh. The mesh must outlive the projector and must not change while it is shared.
+    void shareVertices(const Mesh& mesh);
+
+    // Project all vertices; the returned buffer stays valid until the next call
+    const std::vector<cv::Point2f>& project(const cv::Mat& rvec, const cv::Mat& tvec, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs);
+
+    size_t size() const { return count; }
+    int64_t projections() const { return projectionCount; }
+    int64_t cacheHits() const { return cacheHitCount; }
+
+    double epsilon = 1e-6;  // Largest rvec/tvec change that still reuses the previous projection
+
+private:
+    std::vector<float> positions;         // All x, then all y, then all z
+    const Mesh* sharedMesh = nullptr;     // Positions are read from here instead when set
+    std::vector<cv::Point2f> projected;
+    std::vector<cv::Point3f> fallbackPoints;  // Only used for distortion models the fast path does not cover
+    size_t count = 0;
+
+    bool cacheValid = false;
+    cv::Vec3d lastRvec, lastTvec;
+    CameraIntrinsics lastIntrinsics;
+    int64_t projectionCount = 0, cacheHitCount = 0;
+};
@@ -0,0 +1,143 @@
+#include "WorkStealingPool.h"
+#include "Profiler.h"
+#include <algorithm>
+
+namespace {
+
+// The pool and worker index of the calling thread, so submit() can find the worker's own deque
+thread_local WorkStealingPool* currentPool = nullptr;
+thread_local int currentWorker = -1;
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(int threadCount) {
+    if (threadCount <= 0) {
+        threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+    }
+    for (int i = 0; i < threadCount; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < threadCount; ++i) {
+        threads.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::submit(Task task) {
+    if (currentPool != this) {
+        submitShared(std::move(task));
+        return;
+    }
+    unfinished++;
+    {
+        Worker& worker = *workers[currentWorker];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+    taskQueued();
+}
+
+void WorkStealingPool::submitShared(Task task) {
+    unfinished++;
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        sharedTasks.push_back(std::move(task));
+    }
+    taskQueued();
+}
+
+void WorkStealingPool::taskQueued() {
+    queued++;
+    // Taking the lock orders the count update before a sleeping worker re-checks it, so the wake-up cannot be lost
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wake.notify_one();
+}
+
+void WorkStealingPool::waitIdle() {
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    idle.wait(lock, [this] { return unfinished.load() == 0; });
+}
+
+PoolStats WorkStealingPool::stats() const {
+    PoolStats result;
+    result.tasksRun = tasksRun.load();
+    result.localTasks = localTasks.load();
+    result.sharedTasks = sharedTaken.load();
+    result.steals = steals.load();
+    return result;
+}
+
+bool WorkStealingPool::takeTask(int index, Task& task) {
+    // Own deque, newest first
+    {
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            localTasks++;
+            return true;
+        }
+    }
+
+    // Shared FIFO, oldest first
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        if (!sharedTasks.empty()) {
+            task = std::move(sharedTasks.front());
+            sharedTasks.pop_front();
+            sharedTaken++;
+            return true;
+        }
+    }
+
+    // Steal the oldest task of the next busy worker
+    for (size_t offset = 1; offset < workers.size(); ++offset) {
+        Worker& victim = *workers[(index + offset) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(int index) {
+    currentPool = this;
+    currentWorker = index;
+    profilerSetThreadName("pool worker");
+
+    Task task;
+    while (true) {
+        if (takeTask(index, task)) {
+            queued--;
+            task();
+            task = nullptr;
+            tasksRun++;
+            if (--unfinished == 0) {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                idle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0) {
+            return;
+        }
+    }
+}
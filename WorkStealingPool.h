@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+struct PoolStats {
+    int64_t tasksRun = 0;
+    int64_t localTasks = 0;    // Taken from the running worker's own deque
+    int64_t sharedTasks = 0;   // Taken from the shared FIFO
+    int64_t steals = 0;        // Taken from another worker's deque
+};
+
+// Thread pool with one deque per worker plus a shared FIFO.
+// A worker runs its own newest task first (continuations stay on the thread whose caches hold their data),
+// then the oldest shared task, and only then steals the oldest task of another worker.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    // threadCount <= 0 uses one thread per hardware thread
+    explicit WorkStealingPool(int threadCount = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Called from one of this pool's workers, push onto that worker's deque; otherwise onto the shared FIFO
+    void submit(Task task);
+
+    // Queue behind every task already waiting in the shared FIFO; use this to take turns between producers
+    void submitShared(Task task);
+
+    // Block until every submitted task, including tasks they submitted, has finished
+    void waitIdle();
+
+    int size() const { return int(threads.size()); }
+    PoolStats stats() const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(int index);
+    bool takeTask(int index, Task& task);
+    void taskQueued();
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::mutex sharedMutex;
+    std::deque<Task> sharedTasks;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake, idle;
+    std::atomic<int64_t> queued{0};       // Tasks waiting in any deque
+    std::atomic<int64_t> unfinished{0};   // Tasks submitted but not yet finished
+    bool stopping = false;
+
+    std::atomic<int64_t> tasksRun{0}, localTasks{0}, sharedTaken{0}, steals{0};
+};
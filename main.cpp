@@ -3,6 +3,22 @@
 #include "AugmentedReality.h"
 #include "FeatureDetection.h"
 #include "ModelLoader.h"
+#include "FramePipeline.h"
+#include "VertexProjector.h"
+#include "SoftwareRasterizer.h"
+#include "Benchmark.h"
+#include "BatchCalibration.h"
+#include "CalibrationFile.h"
+#include "UndistortionCache.h"
+#include "FeaturePoseTracker.h"
+#include "PoseEstimator.h"
+#include "Profiler.h"
+#include "MultiStream.h"
+#include "Scene.h"
+#include "FrameArena.h"
+#include "AllocationCounter.h"
+#include "Recorder.h"
+#include "FrameBudget.h"
 #include <opencv2/opencv.hpp>
 #include <vector>
 #include <iostream>
@@ -10,7 +26,10 @@
 #include <fstream>
 #include <thread>
 #include <atomic>
-#include <regex>
+#include <mutex>
+#include <optional>
+#include <chrono>
+#include <filesystem>
 
 // Global atomic variable to store the key pressed
 std::atomic<char> keyPressed(' ');
@@ -21,6 +40,12 @@ std::atomic<bool> displayVirtualObjectPersistent(false);
 // Global flag to control the display of features
 std::atomic<bool> displayFeatures(false);
 
+// Global flag to show Harris corners instead of ORB keypoints
+std::atomic<bool> useHarrisFeatures(false);
+
+// Global flag to remove lens distortion from each frame before detection
+std::atomic<bool> undistortFrames(false);
+
 // Function to capture key input from the console
 void captureKeyInput() {
     char key;
@@ -33,46 +58,6 @@ void captureKeyInput() {
     }
 }
 
-// Function to read Camera Matrix from a local csv file
-bool readCalibrationData(const std::string& filename, cv::Mat& cameraMatrix, cv::Mat& distCoefficients) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open file " << filename << std::endl;
-        return false;
-    }
-
-    std::string line;
-    std::regex number_regex("[-+]?[0-9]*\\.?[0-9]+([eE][-+]?[0-9]+)?"); // Regular expression for floating point numbers
-    std::smatch match;
-
-    while (std::getline(file, line)) {
-        if (line.find("Camera Matrix:") != std::string::npos) {
-            // Read camera matrix
-            for (int i = 0; i < 3; ++i) {
-                std::getline(file, line);
-                int j = 0;
-                while (std::regex_search(line, match, number_regex) && j < 3) {
-                    cameraMatrix.at<double>(i, j) = std::stod(match.str(0));
-                    line = match.suffix().str();
-                    j++;
-                }
-            }
-        }
-        else if (line.find("Distortion Coefficients:") != std::string::npos) {
-            // Read distortion coefficients
-            for (int i = 0; i < 5; ++i) {
-                std::getline(file, line);
-                if (std::regex_search(line, match, number_regex)) {
-                    distCoefficients.at<double>(i, 0) = std::stod(match.str(0));
-                }
-            }
-        }
-    }
-
-    file.close();
-    return true;
-}
-
 // Function to define 3D points for the axes
 std::vector<cv::Point3f> defineAxesPoints() {
     std::vector<cv::Point3f> axesPoints;
@@ -83,30 +68,8 @@ std::vector<cv::Point3f> defineAxesPoints() {
     return axesPoints;
 }
 
-// Function to check if a point is inside a rectangle defined by four points
-bool isInsideRectangle(const cv::Point2f& p, const std::vector<cv::Point2f>& rect) {
-    double area1 = cv::contourArea(rect);
-    double area2 = cv::contourArea(std::vector<cv::Point2f>{rect[0], rect[1], p}) +
-        cv::contourArea(std::vector<cv::Point2f>{rect[1], rect[2], p}) +
-        cv::contourArea(std::vector<cv::Point2f>{rect[2], rect[3], p}) +
-        cv::contourArea(std::vector<cv::Point2f>{rect[3], rect[0], p});
-    return std::abs(area1 - area2) < 1e-3;
-}
-
 // Function to draw virtual object
-void drawVirtualObject(cv::Mat& frame, const cv::Mat& cameraMatrix, const cv::Mat& distCoefficients, const cv::Mat& rvec, const cv::Mat& tvec, const std::vector<cv::Point2f>& chessboardCorners, const cv::Size& patternSize) {
-    // Define the chessboard boundary
-    std::vector<cv::Point2f> chessboardBoundary = {
-        chessboardCorners.front(),
-        chessboardCorners[patternSize.width - 1],
-        chessboardCorners.back(),
-        chessboardCorners[patternSize.width * (patternSize.height - 1)]
-    };
-
-    // Define 3D coordinates of the virtual object (pyramid with a square base)
-    float baseSize = 0.5f; // Size of the base of the pyramid
-    float height = 0.5f; // Height of the pyramid
-
+void drawVirtualObject(cv::Mat& frame, const cv::Mat& cameraMatrix, const cv::Mat& distCoefficients, const cv::Mat& rvec, const cv::Mat& tvec, const cv::Size& patternSize, FrameArena& arena) {
     // Assuming the chessboard size is 9x6 and each square is 1 unit
     float boardCenterX = patternSize.width / 2.0f - 0.5f;
     float boardCenterY = -(patternSize.height / 2.0f - 0.5f);  // negative because Y-axis points downwards in image space
@@ -115,35 +78,23 @@ void drawVirtualObject(cv::Mat& frame, const cv::Mat& cameraMatrix, const cv::Ma
     float offsetX = boardCenterX;
     float offsetY = boardCenterY;
 
-    std::vector<cv::Point3f> objectPoints = {
-        cv::Point3f(-0.5f + offsetX, -0.5f + offsetY, 0), // Bottom left
-        cv::Point3f(0.5f + offsetX, -0.5f + offsetY, 0),  // Bottom right
-        cv::Point3f(0.5f + offsetX, 0.5f + offsetY, 0),   // Top right
-        cv::Point3f(-0.5f + offsetX, 0.5f + offsetY, 0),  // Top left
-        cv::Point3f(offsetX, offsetY, height)             // Tip of the pyramid
+    // Define 3D coordinates of the virtual object (pyramid with a square base). The base is sized on the board
+    // plane so it stays inside the outer corners, which needs no projection and no retry.
+    float baseSize = std::min(0.5f, std::min(offsetX, -offsetY)); // Half the width of the base of the pyramid
+    float height = baseSize; // Height of the pyramid
+
+    cv::Point3f objectPoints[5] = {
+        cv::Point3f(-baseSize + offsetX, -baseSize + offsetY, 0), // Bottom left
+        cv::Point3f(baseSize + offsetX, -baseSize + offsetY, 0),  // Bottom right
+        cv::Point3f(baseSize + offsetX, baseSize + offsetY, 0),   // Top right
+        cv::Point3f(-baseSize + offsetX, baseSize + offsetY, 0),  // Top left
+        cv::Point3f(offsetX, offsetY, height)                     // Tip of the pyramid
     };
 
-    // Project the 3D points to the image plane
-    std::vector<cv::Point2f> imagePoints;
-    cv::projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoefficients, imagePoints);
-
-    // Check if any projected points are outside the chessboard boundary
-    for (const auto& point : imagePoints) {
-        if (!isInsideRectangle(point, chessboardBoundary)) {
-            // Scale down the object if any point is outside
-            baseSize *= 0.75f;
-            height *= 0.75f;
-            objectPoints = {
-                cv::Point3f(-baseSize + offsetX, -baseSize + offsetY, 0), // Bottom left
-                cv::Point3f(baseSize + offsetX, -baseSize + offsetY, 0), // Bottom right
-                cv::Point3f(baseSize + offsetX, baseSize + offsetY, 0), // Top right
-                cv::Point3f(-baseSize + offsetX, baseSize + offsetY, 0), // Top left
-                cv::Point3f(offsetX, offsetY, height) // Tip of the pyramid
-            };
-            cv::projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoefficients, imagePoints);
-            break;
-        }
-    }
+    // Project the 3D points to the image plane; both point lists live on the stack or in the frame arena
+    cv::Mat imagePointsMat = arena.mat(5, 1, CV_32FC2);
+    cv::projectPoints(cv::Mat(5, 1, CV_32FC3, objectPoints), rvec, tvec, cameraMatrix, distCoefficients, imagePointsMat);
+    const cv::Point2f* imagePoints = imagePointsMat.ptr<cv::Point2f>();
 
     // Draw the virtual object (pyramid) on the frame using lines
     for (int i = 0; i < 4; ++i) {
@@ -157,73 +108,379 @@ void drawVirtualObject(cv::Mat& frame, const cv::Mat& cameraMatrix, const cv::Ma
     }
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // "--bench-load <obj> [runs]" times the OBJ loaders and exits without opening the camera
+    if (argc >= 3 && std::string(argv[1]) == "--bench-load") {
+        benchmarkModelLoad(argv[2], argc >= 4 ? std::atoi(argv[3]) : 5);
+        return 0;
+    }
+
+    // "--check-lod" checks the geometric error of the mesh simplification used for the levels of detail
+    if (argc >= 2 && std::string(argv[1]) == "--check-lod") {
+        return checkMeshSimplification() ? 0 : -1;
+    }
+
+    // "--bench-undistort <calibration> [runs]" times the undistortion remap and the projection calls with and without distortion
+    if (argc >= 3 && std::string(argv[1]) == "--bench-undistort") {
+        benchmarkUndistortion(argv[2], argc >= 4 ? std::atoi(argv[3]) : 50);
+        return 0;
+    }
+
+    // "--bench-features [runs]" times the per-call and grid feature detectors at several resolutions
+    if (argc >= 2 && std::string(argv[1]) == "--bench-features") {
+        benchmarkFeatureDetection(argc >= 3 ? std::atoi(argv[2]) : 30);
+        return 0;
+    }
+
+    // "--bench-ba [max views] [compare limit]" times the bundle adjustment against cv::calibrateCamera on synthetic views
+    if (argc >= 2 && std::string(argv[1]) == "--bench-ba") {
+        benchmarkBundleAdjustment(argc >= 3 ? std::atoi(argv[2]) : 1000, argc >= 4 ? std::atoi(argv[3]) : 100);
+        return 0;
+    }
+
+    // "--bench-detectors [inputs...] [--calibration <file>] [--passes <n>]" compares the chessboard detector backends
+    if (argc >= 2 && std::string(argv[1]) == "--bench-detectors") {
+        std::vector<std::string> inputs;
+        std::string calibrationPath;
+        int passes = 3;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--calibration" && i + 1 < argc) calibrationPath = argv[++i];
+            else if (arg == "--passes" && i + 1 < argc) passes = std::atoi(argv[++i]);
+            else inputs.push_back(arg);
+        }
+        return benchmarkBoardDetectors(inputs, calibrationPath, passes) ? 0 : -1;
+    }
+
+    // "--replay [inputs...] [--calibration <file>] [--model <obj>] [--json <file>] [--passes <n>]" runs the headless replay benchmark
+    if (argc >= 2 && std::string(argv[1]) == "--replay") {
+        ReplayOptions options;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--calibration" && hasValue) options.calibrationPath = argv[++i];
+            else if (arg == "--model" && hasValue) options.modelPath = argv[++i];
+            else if (arg == "--json" && hasValue) options.jsonPath = argv[++i];
+            else if (arg == "--passes" && hasValue) options.passes = std::atoi(argv[++i]);
+            else options.inputs.push_back(arg);
+        }
+        return runReplayBenchmark(options) ? 0 : -1;
+    }
+
+    // "--streams <input> <calibration> [<input> <calibration> ...] [--model <obj>] [--threads <n>] [--frames <n>] [--headless] [--detector <name>]"
+    // processes several cameras or videos, each with its own calibration, on one shared thread pool
+    if (argc >= 2 && std::string(argv[1]) == "--streams") {
+        MultiStreamOptions options;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--model" && hasValue) options.modelPath = argv[++i];
+            else if (arg == "--threads" && hasValue) options.threads = std::atoi(argv[++i]);
+            else if (arg == "--frames" && hasValue) options.maxFrames = std::atoll(argv[++i]);
+            else if (arg == "--headless") options.display = false;
+            else if (arg == "--profile") setProfilingEnabled(true);
+            else if (arg == "--detector" && hasValue) {
+                if (!parseBoardDetectorBackend(argv[++i], options.detector)) {
+                    std::cerr << "Unknown detector " << argv[i] << "; use classic, fast, sb or precheck" << std::endl;
+                    return -1;
+                }
+            }
+            else if (hasValue) options.streams.push_back({ arg, argv[++i] });
+            else std::cerr << "Ignoring stream " << arg << " without a calibration file" << std::endl;
+        }
+        bool ok = runMultiStream(options);
+        if (profileHasEvents()) {
+            writeChromeTrace("profile_trace.json");
+            writeProfileSummaryCsv("profile_summary.csv");
+        }
+        return ok ? 0 : -1;
+    }
+
+    // "--calibrate-dir <dir> [output]" calibrates from stored captures without a camera or window
+    if (argc >= 3 && std::string(argv[1]) == "--calibrate-dir") {
+        std::string outputPath = argc >= 4 ? argv[3] : (std::filesystem::path(argv[2]) / "calibration.calib").string();
+        return runBatchCalibration(argv[2], cv::Size(9, 6), outputPath) ? 0 : -1;
+    }
+
+    // "--serial" runs capture, detection and rendering back to back for comparison with the pipelined loop
+    // "--no-tracking" searches the whole frame for the chessboard every time
+    // "--undistort" starts with frame undistortion on (toggle with 'u')
+    // "--no-feature-tracking" drops the pose as soon as the chessboard is not found
+    // "--cold-pose" solves every pose from scratch; "--compare-pose" also times the cold solve on every frame
+    // "--profile" records per-stage timings from the first frame (toggle with 't')
+    // "--scene <file>" places the models listed in a scene file instead of the single tree
+    // "--no-lod" always draws the full model instead of a simplified level sized to its screen area
+    // "--record <file>" writes the annotated frames and a pose sidecar from the first frame (toggle with 'r');
+    // "--codec <fourcc>", "--record-fps <n>" and "--record-queue <n>" set the codec, frame rate and encoder queue depth
+    // "--detector <classic|fast|sb|precheck>" selects the chessboard detector backend
+    // "--budget <ms>" lowers detection and drawing quality whenever the frame's work runs over the target time
+    bool useSerialLoop = false;
+    bool useTracking = true;
+    bool useFeatureTracking = true;
+    bool useWarmPose = true;
+    bool comparePose = false;
+    std::string scenePath;
+    bool useLod = true;
+    RecorderConfig recorderConfig;
+    bool recordFromStart = false;
+    double frameBudgetMs = 0.0;
+    BoardDetectorBackend detectorBackend = BoardDetectorBackend::Classic;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--serial") {
+            useSerialLoop = true;
+        }
+        else if (std::string(argv[i]) == "--no-tracking") {
+            useTracking = false;
+        }
+        else if (std::string(argv[i]) == "--undistort") {
+            undistortFrames = true;
+        }
+        else if (std::string(argv[i]) == "--no-feature-tracking") {
+            useFeatureTracking = false;
+        }
+        else if (std::string(argv[i]) == "--cold-pose") {
+            useWarmPose = false;
+        }
+        else if (std::string(argv[i]) == "--compare-pose") {
+            comparePose = true;
+        }
+        else if (std::string(argv[i]) == "--profile") {
+            setProfilingEnabled(true);
+        }
+        else if (std::string(argv[i]) == "--no-lod") {
+            useLod = false;
+        }
+        else if (std::string(argv[i]) == "--scene" && i + 1 < argc) {
+            scenePath = argv[++i];
+        }
+        else if (std::string(argv[i]) == "--record" && i + 1 < argc) {
+            recorderConfig.path = argv[++i];
+            recordFromStart = true;
+        }
+        else if (std::string(argv[i]) == "--codec" && i + 1 < argc) {
+            recorderConfig.codec = argv[++i];
+        }
+        else if (std::string(argv[i]) == "--record-fps" && i + 1 < argc) {
+            recorderConfig.fps = std::atof(argv[++i]);
+        }
+        else if (std::string(argv[i]) == "--detector" && i + 1 < argc) {
+            if (!parseBoardDetectorBackend(argv[++i], detectorBackend)) {
+                std::cerr << "Unknown detector " << argv[i] << "; use classic, fast, sb or precheck" << std::endl;
+                return -1;
+            }
+        }
+        else if (std::string(argv[i]) == "--budget" && i + 1 < argc) {
+            frameBudgetMs = std::atof(argv[++i]);
+        }
+        else if (std::string(argv[i]) == "--record-queue" && i + 1 < argc) {
+            recorderConfig.queueDepth = size_t(std::max(1, std::atoi(argv[++i])));
+        }
+    }
+
     cv::VideoCapture cap(0);
     if (!cap.isOpened()) {
         std::cerr << "Error: Could not open camera." << std::endl;
         return -1;
     }
 
-    // Start a separate thread for capturing key input from the console
-    std::thread keyInputThread(captureKeyInput);
-
     cv::Size patternSize(9, 6); // Size of the chessboard pattern
-    std::vector<cv::Point2f> corner_set; // To store the detected corners
-    std::vector<std::vector<cv::Point2f>> corner_list; // To store corners for multiple frames
-    std::vector<std::vector<cv::Vec3f>> point_list; // To store 3D world points for calibration
-    cv::Mat frame, cameraMatrix = cv::Mat::eye(3, 3, CV_64F), distCoefficients = cv::Mat::zeros(8, 1, CV_64F);
+    IncrementalCalibrator calibrator(patternSize); // Keeps the informative calibration views and a running solution
+    cv::Mat cameraMatrix = cv::Mat::eye(3, 3, CV_64F), distCoefficients = cv::Mat::zeros(8, 1, CV_64F);
     bool foundPreviously = false;
     int imageCounter = 0; // Counter for saved images
 
-    std::string calibrationFilePath = "C:\\Users\\Shi Zhang\\source\\repos\\cs5330_project04_calibration&AugmentedReality\\res\\calibration_data.csv";
-    if (!readCalibrationData(calibrationFilePath, cameraMatrix, distCoefficients)) {
+    // Prefer the versioned binary calibration; fall back to the older text file when none was saved yet
+    std::string calibrationFilePath = "C:\\Users\\Shi Zhang\\source\\repos\\cs5330_project04_calibration&AugmentedReality\\res\\calibration.calib";
+    std::string legacyCalibrationFilePath = "C:\\Users\\Shi Zhang\\source\\repos\\cs5330_project04_calibration&AugmentedReality\\res\\calibration_data.csv";
+    CalibrationData calibration;
+    bool calibrationLoaded = std::filesystem::exists(calibrationFilePath)
+        ? loadCalibration(calibrationFilePath, calibration)
+        : loadCalibration(legacyCalibrationFilePath, calibration);
+    if (!calibrationLoaded) {
         std::cerr << "Failed to read calibration data." << std::endl;
         return -1;
     }
+    cameraMatrix = calibration.cameraMatrix;
+    if (!calibration.distCoeffs.empty()) {
+        distCoefficients = calibration.distCoeffs;
+    }
 
-    // Load the 3D model
-    std::vector<Vertex> vertices;
-    std::vector<TextureCoord> textures;
-    std::vector<Normal> normals;
-    std::vector<Face> faces;
+    // The undistortion map for the current calibration is kept on disk so startup can skip rebuilding it
+    std::string undistortMapFilePath = !calibration.undistortMapPath.empty() ? calibration.undistortMapPath
+        : "C:\\Users\\Shi Zhang\\source\\repos\\cs5330_project04_calibration&AugmentedReality\\res\\calibration.undistort";
+
+    // Load the 3D models once; by default the scene is the single tree at the board origin
+    Scene scene;
     std::string modelPath = "C:\\Users\\Shi Zhang\\source\\repos\\cs5330_project04_calibration&AugmentedReality\\res\\Lowpoly_tree_sample2.obj";
-    if (!loadOBJModel(modelPath, vertices, textures, normals, faces)) {
+    bool sceneLoaded = !scenePath.empty() ? scene.load(scenePath) : scene.addModel("tree", modelPath) >= 0;
+    if (!sceneLoaded || scene.models().empty()) {
         std::cerr << "Failed to load the model." << std::endl;
         return -1;
     }
-    
+    if (scenePath.empty()) {
+        scene.addInstance(0, cv::Vec3f(0.0f, 0.0f, 0.0f));
+    }
+    scene.useLod = useLod;
+
     // Flags to control the display of 3D axes and virtual object
     bool display3DAxes = false;
     bool displayVirtualObject = false;
 
+    // Solid rendering of the scene; empty means wireframe
+    std::optional<ShadingMode> solidShading;
+    SoftwareRasterizer modelRasterizer;
+
     // print the camera matrix from calibration file
     std::cout << "Camera Matrix:" << std::endl << cameraMatrix << std::endl;
     std::cout << "Distortion Coefficients:" << std::endl << distCoefficients << std::endl;
 
 
     // instructions for user to navigate the program
-    std::cout << "Press 's' to save a calibration image. Press 'c' to perform calibration. Press 'p' to print board's pose. Press 'd' to display the virtual object persistently on the chessboard. Press 'f' to display a robust feature on the chessboard. Press 'q' to exit." << std::endl;
+    std::cout << "Press 's' to save a calibration image. Press 'c' to perform calibration. Press 'p' to print board's pose. Press 'd' to display the virtual object persistently on the chessboard. Press 'f' to display a robust feature on the chessboard. Press 'h' to switch the features between ORB and Harris corners. Press 'm' to switch the model between wireframe, flat and smooth shading. Press 'u' to toggle frame undistortion. Press 'q' to exit." << std::endl;
 
     std::vector<cv::Point3f> axesPoints = defineAxesPoints();
-    cv::Mat rvec, tvec;
-    bool solvePnP_success = false;
-    std::vector<cv::Vec3f> objectPoints;
 
-    while (true) {
-        cap >> frame;
-        if (frame.empty()) break;
+    // Predicts the next pose and refines it from there instead of solving each frame from scratch; only used by the detection stage
+    PoseEstimator poseEstimator(patternSize);
+    poseEstimator.warmStart = useWarmPose;
+    poseEstimator.smooth = useWarmPose;
+    poseEstimator.compareCold = comparePose;
 
-        // Task 1: Detect and draw chessboard corners
-        bool found = findChessboardCorners(frame, patternSize, corner_set);
-        if (found) {
-            objectPoints.clear();
-            for (int i = 0; i < patternSize.height; ++i) {
-                for (int j = 0; j < patternSize.width; ++j) {
-                    objectPoints.push_back(cv::Vec3f(j, -i, 0.0f));
-                }
+    // Follows the board between frames; only used by the detection stage
+    ChessboardTracker tracker(patternSize);
+    tracker.backend = detectorBackend;
+
+    // Keeps the pose from board-anchored features while the chessboard is occluded; only used by the detection stage
+    FeaturePoseTracker featureTracker(patternSize);
+
+    // The render stage writes the calibration while the detection stage reads it
+    std::mutex calibrationMutex;
+
+    // Undistorted frames are projected with the same camera matrix and no distortion terms
+    const cv::Mat noDistortion;
+    UndistortionCache undistorter;  // Only used by the detection stage
+    cv::Mat undistortBuffer;
+
+    // Keeps its detectors and buffers across frames; only used by the detection stage
+    FeatureDetector featureDetector;
+
+    // Cost of the pose and projection calls with and without distortion terms ([0] distorted, [1] undistorted)
+    StageTiming poseTiming[2], projectionTiming[2];
+    std::vector<cv::Point2f> predictedCorners;
+
+    // Transient per-frame buffers come from one arena per stage, reset at the start of every frame.
+    // Heap allocations (including cv::Mat buffers) are counted per stage to check the steady state stays near zero.
+    countMatAllocations();
+    FrameArena detectArena, renderArena;
+    FrameAllocationStats detectAllocations, renderAllocations;
+
+    // Annotated frames are encoded on a background thread so recording never waits on the encoder
+    Recorder recorder(recorderConfig);
+    if (recordFromStart && !recorder.start()) {
+        return -1;
+    }
+
+    // Start a separate thread for capturing key input from the console, after the last early return
+    std::thread keyInputThread(captureKeyInput);
+
+    // Each stage reports its time to the governor and reads back the quality level it should run at
+    std::optional<FrameBudgetGovernor> governor;
+    if (frameBudgetMs > 0.0) {
+        governor.emplace(frameBudgetMs, !useSerialLoop);
+    }
+    DetectionSettings detectionSettings;
+
+    // Detection stage: find the chessboard and estimate its pose
+    auto detectStage = [&](FrameSlot& slot) {
+        FrameAllocationScope allocationScope(detectArena, detectAllocations);
+        auto stageStart = std::chrono::steady_clock::now();
+        if (governor) {
+            DetectQuality quality = governor->detectQuality();
+            detectionSettings = quality.detection;
+            tracker.settings = quality.detection;
+            featureDetector.setPerCellBudget(quality.featuresPerCell);
+        }
+        cv::Mat K, D;
+        {
+            std::lock_guard<std::mutex> lock(calibrationMutex);
+            K = cameraMatrix;
+            D = distCoefficients;
+        }
+
+        // The map is only rebuilt when the calibration or the frame size changes
+        slot.undistorted = undistortFrames.load() && undistorter.update(K, D, slot.frame.size(), undistortMapFilePath);
+        if (slot.undistorted) {
+            undistorter.apply(slot.frame, undistortBuffer);
+            cv::swap(slot.frame, undistortBuffer);
+            D = noDistortion;
+        }
+
+        // Features are found here, off the display thread, and only drawn by the render stage
+        slot.hasFeatures = displayFeatures.load();
+        if (slot.hasFeatures) {
+            featureDetector.setType(useHarrisFeatures.load() ? FeatureType::Harris : FeatureType::ORB);
+            const std::vector<cv::KeyPoint>& features = featureDetector.detect(slot.frame);
+            slot.features.assign(features.begin(), features.end());
+            slot.featureType = featureDetector.featureType();
+        }
+
+        // While the pose comes from features, the chessboard detector only runs every few frames
+        bool detectBoard = !useFeatureTracking || featureTracker.shouldDetectBoard();
+        featureTracker.beginFrame(detectBoard);
+        slot.found = false;
+        if (detectBoard) {
+            // Corners where the predicted pose puts them seed the tracker's flow and region search
+            bool predicted = useTracking && poseEstimator.predictCorners(slot.captureTime, K, D, predictedCorners);
+            slot.found = useTracking ? tracker.track(slot.frame, slot.corner_set, predicted ? &predictedCorners : nullptr)
+                : findChessboardCorners(slot.frame, patternSize, slot.corner_set, &detectArena, detectionSettings, detectorBackend);
+        }
+        slot.poseValid = false;
+        slot.cornersPredicted = false;
+        if (slot.found) {
+            auto start = std::chrono::steady_clock::now();
+            slot.poseValid = poseEstimator.estimate(slot.corner_set, K, D, slot.captureTime, slot.rvec, slot.tvec);
+            poseTiming[slot.undistorted].add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            if (slot.poseValid && useFeatureTracking) {
+                featureTracker.boardFound(slot.frame, slot.corner_set, slot.rvec, slot.tvec);
             }
+        }
+        if (!slot.poseValid && useFeatureTracking && featureTracker.trackFeatures(slot.frame, K, D, slot.rvec, slot.tvec, slot.corner_set, slot.trackedFeatures)) {
+            slot.found = true;
+            slot.poseValid = true;
+            slot.cornersPredicted = true;
+            poseEstimator.observe(slot.captureTime, slot.rvec, slot.tvec);
+        }
+        if (governor) {
+            governor->reportDetect(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stageStart).count());
+        }
+    };
+
+    // Render stage: draw the overlays, handle console keys and display the frame
+    auto renderStage = [&](FrameSlot& slot) {
+        FrameAllocationScope allocationScope(renderArena, renderAllocations);
+        auto stageStart = std::chrono::steady_clock::now();
+        if (governor) {
+            RenderQuality quality = governor->renderQuality();
+            scene.drawVertices = quality.drawVertices;
+            scene.lodPixelsPerTriangle = quality.lodPixelsPerTriangle;
+        }
+        cv::Mat& frame = slot.frame;
+        const std::vector<cv::Point2f>& corner_set = slot.corner_set;
+        const cv::Mat& rvec = slot.rvec;
+        const cv::Mat& tvec = slot.tvec;
+        bool found = slot.found;
+        bool solvePnP_success = slot.poseValid;
+        const cv::Mat& frameDistortion = slot.undistorted ? noDistortion : distCoefficients;
+
+        // Detection only finds the corners and the tracked features; they are drawn here, where the frame is shown
+        if (found && !slot.cornersPredicted) {
+            drawBoardCorners(frame, patternSize, corner_set);
+        }
+        else if (found) {
+            drawTrackedFeatures(frame, slot.trackedFeatures);
+        }
 
-            solvePnP_success = cv::solvePnP(objectPoints, corner_set, cameraMatrix, distCoefficients, rvec, tvec);
+        if (found) {
             if (!foundPreviously) {
                 // Print corner info only when chessboard is first detected
                 std::cout << "Number of corners found: " << corner_set.size() << std::endl;
@@ -239,8 +496,9 @@ int main() {
 
         // Task 5: Project 3D Axes on the Chessboard
         if (found && display3DAxes && solvePnP_success) {
-            std::vector<cv::Point2f> imagePoints;
-            cv::projectPoints(axesPoints, rvec, tvec, cameraMatrix, distCoefficients, imagePoints);
+            cv::Mat imagePointsMat = renderArena.mat(int(axesPoints.size()), 1, CV_32FC2);
+            cv::projectPoints(axesPoints, rvec, tvec, cameraMatrix, frameDistortion, imagePointsMat);
+            const cv::Point2f* imagePoints = imagePointsMat.ptr<cv::Point2f>();
 
             // Drawing the axes on the image
             cv::line(frame, imagePoints[0], imagePoints[1], cv::Scalar(0, 0, 255), 3); // X-axis in red
@@ -249,60 +507,72 @@ int main() {
         }
 
         // Task 6: Draw Virtual Object
-        if (found && displayVirtualObject && solvePnP_success) {
+        if (found && displayVirtualObject && solvePnP_success && solidShading) {
+            // Filled, depth-tested instances from the tile rasterizer, culled and sized like the wireframe
+            modelRasterizer.shading = *solidShading;
+            scene.drawSolid(frame, modelRasterizer, rvec, tvec, cameraMatrix, frameDistortion);
+            projectionTiming[slot.undistorted].add(scene.stats().lastProjectMs);
+        }
+        else if (found && displayVirtualObject && solvePnP_success) {
             // Task 6: Draw Virtual Object
 
-            // Project vertices of the model onto the image
-            std::vector<cv::Point2f> modelImagePoints;
-            for (const Vertex& vertex : vertices) {
-                std::vector<cv::Point3f> singlePoint = { cv::Point3f(vertex.x, vertex.y, vertex.z) };
-                std::vector<cv::Point2f> projectedPoint;
-                cv::projectPoints(singlePoint, rvec, tvec, cameraMatrix, distCoefficients, projectedPoint);
-                modelImagePoints.push_back(projectedPoint[0]);
-            }
+            // Instances outside the view are culled by their bounding spheres; the rest are projected in batched passes
+            scene.draw(frame, rvec, tvec, cameraMatrix, frameDistortion);
+            projectionTiming[slot.undistorted].add(scene.stats().lastProjectMs);
+        }
 
-            // Draw the projected points onto the image
-            for (const auto& point : modelImagePoints) {
-                cv::circle(frame, point, 2, cv::Scalar(0, 255, 0), -1);  // Draw a small green circle at each projected vertex
-            }
+        // Only the drawing counts toward the frame budget; key handling, imshow and the recorder hand-off are left out
+        double drawMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stageStart).count();
 
-            // For visualization purposes, draw lines between the vertices of each face.
-            for (const auto& face : faces) {
-                for (int i = 0; i < face.vertexIndices.size(); i++) {
-                    cv::Point2f p1 = modelImagePoints[face.vertexIndices[i] - 1]; // -1 because OBJ indices are 1-based
-                    cv::Point2f p2 = modelImagePoints[face.vertexIndices[(i + 1) % face.vertexIndices.size()] - 1];
-                    cv::line(frame, p1, p2, cv::Scalar(255, 0, 0), 1);  // Draw line in blue
-                }
-            }
+        // Pick up a calibration solved in the background since the last frame
+        if (calibrator.update()) {
+            std::cout << "Running re-projection error: " << calibrator.reprojectionError() << " (solved in " << calibrator.lastSolveMs() << " ms)" << std::endl;
         }
 
         // Check if any key is pressed in the console
         char key = keyPressed.load();
         if (key != ' ') {
             // Task 2: Select Calibration Images
-            if (key == 's' && found) {
-                corner_list.push_back(corner_set);
-                std::vector<cv::Vec3f> point_set;
-                for (int i = 0; i < patternSize.height; ++i) {
-                    for (int j = 0; j < patternSize.width; ++j) {
-                        point_set.push_back(cv::Vec3f(j, -i, 0.0f)); // Assuming each square is 1 unit
-                    }
-                }
-                point_list.push_back(point_set);
-                std::cout << "Saved calibration image with " << corner_set.size() << " corners." << std::endl;
+            if (key == 's' && found && slot.cornersPredicted) {
+                std::cerr << "The board is only tracked from features; show the whole chessboard to save a calibration image." << std::endl;
+            }
+            else if (key == 's' && found && slot.undistorted) {
+                std::cerr << "Turn off undistortion with 'u' before saving calibration images." << std::endl;
+            }
+            else if (key == 's' && found) {
+                ViewScore score = calibrator.addView(corner_set, frame.size(), cameraMatrix, distCoefficients);
+                std::cout << "Calibration image with " << corner_set.size() << " corners: coverage gain " << score.coverageGain * 100.0
+                    << "%, pose difference " << score.poseDistanceDeg << " deg, "
+                    << (score.accepted ? (score.replacedView ? "kept (replaced a redundant view)" : "kept") : "skipped as redundant")
+                    << ", " << calibrator.viewCount() << " views" << (score.solveQueued ? ", re-solving in the background" : "") << std::endl;
             }
 
             // Task 3: Calibrate the Camera
             else if (key == 'c') {
-                if (corner_list.size() >= 5) {
-                    std::vector<cv::Mat> rvecs, tvecs;
-                    double reProjectionError = cv::calibrateCamera(point_list, corner_list, frame.size(), cameraMatrix, distCoefficients, rvecs, tvecs, cv::CALIB_FIX_ASPECT_RATIO);
+                if (calibrator.isSolving()) {
+                    std::cerr << "The calibration is still being solved with the latest views; press 'c' again once the running error is printed." << std::endl;
+                }
+                else if (calibrator.hasSolution()) {
+                    // Publish fresh matrices so the detection stage never sees a half-written result
+                    cv::Mat newCameraMatrix = calibrator.cameraMatrix().clone(), newDistCoefficients = calibrator.distCoeffs().clone();
+                    double reProjectionError = calibrator.reprojectionError();
+                    {
+                        std::lock_guard<std::mutex> lock(calibrationMutex);
+                        cameraMatrix = newCameraMatrix;
+                        distCoefficients = newDistCoefficients;
+                    }
                     std::cout << "Calibration done with re-projection error: " << reProjectionError << std::endl;
                     std::cout << "Camera Matrix:" << std::endl << cameraMatrix << std::endl;
                     std::cout << "Distortion Coefficients:" << std::endl << distCoefficients << std::endl;
 
                     // Save calibration data
-                    if (saveCalibrationData(calibrationFilePath, cameraMatrix, distCoefficients, reProjectionError)) {
+                    calibration.imageSize = frame.size();
+                    calibration.cameraMatrix = cameraMatrix;
+                    calibration.distCoeffs = distCoefficients;
+                    calibration.rms = reProjectionError;
+                    calibration.undistortMapPath = undistortMapFilePath;
+                    calibration.perViewErrors = calibrator.perViewErrors();
+                    if (saveCalibration(calibrationFilePath, calibration)) {
                         std::cout << "Calibration data saved to " << calibrationFilePath << std::endl;
                     }
                     else {
@@ -330,34 +600,142 @@ int main() {
                 displayVirtualObject = !displayVirtualObject;
             }
 
+            // Cycle the model between wireframe, flat and Gouraud shading when 'm' is pressed
+            if (key == 'm') {
+                if (!solidShading) solidShading = ShadingMode::Flat;
+                else if (*solidShading == ShadingMode::Flat) solidShading = ShadingMode::Gouraud;
+                else solidShading.reset();
+            }
+
+            // Toggle frame undistortion when 'u' is pressed
+            if (key == 'u') {
+                undistortFrames = !undistortFrames;
+            }
+
             // Toggle the displayFeatures flag when 'f' is pressed
             if (key == 'f') {
                 displayFeatures = !displayFeatures;  
             }
 
+            // Switch between ORB keypoints and Harris corners when 'h' is pressed
+            if (key == 'h') {
+                useHarrisFeatures = !useHarrisFeatures;
+            }
+
+            // Toggle profiling when 't' is pressed; stopping writes the trace recorded so far
+            if (key == 't') {
+                bool enable = !profilingEnabled();
+                setProfilingEnabled(enable);
+                if (!enable && writeChromeTrace("profile_trace.json")) {
+                    std::cout << "Profile trace saved to profile_trace.json" << std::endl;
+                }
+            }
+
+            // Start or stop recording when 'r' is pressed; stopping finishes the queued frames first
+            if (key == 'r') {
+                if (recorder.isRecording()) {
+                    recorder.stop();
+                    std::cout << "Recording stopped" << std::endl;
+                    printRecorderStats(recorder.stats(), recorder.path());
+                }
+                else if (!recorder.start()) {
+                    std::cerr << "Error: recording could not be started" << std::endl;
+                }
+            }
+
 
             keyPressed.store(' ');  // Reset the key
         }
 
+        auto overlayStart = std::chrono::steady_clock::now();
         if (displayVirtualObjectPersistent.load() && solvePnP_success) {
             if (found) {
-                drawVirtualObject(frame, cameraMatrix, distCoefficients, rvec, tvec, corner_set, patternSize);
+                drawVirtualObject(frame, cameraMatrix, frameDistortion, rvec, tvec, patternSize, renderArena);
             }
         }
 
-        if (displayFeatures.load()) {
-            detectAndDrawFeatures(frame);
+        if (slot.hasFeatures) {
+            drawFeatures(frame, slot.features, slot.featureType);
         }
+        drawMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - overlayStart).count();
 
         // Display the frame
-        cv::imshow("Frame", frame);
-        cv::waitKey(1);
+        {
+            PROFILE_SCOPE("imshow");
+            cv::imshow("Frame", frame);
+            cv::waitKey(1);
+        }
+
+        // Hand the shown frame to the encoder thread; the slot gets back a buffer the encoder is done with
+        if (recorder.isRecording()) {
+            RecordedPose pose;
+            pose.frameIndex = slot.frameIndex;
+            pose.found = found;
+            pose.poseValid = solvePnP_success;
+            pose.fromFeatures = slot.cornersPredicted;
+            pose.undistorted = slot.undistorted;
+            if (solvePnP_success) {
+                pose.rvec = toVec3d(rvec);
+                pose.tvec = toVec3d(tvec);
+            }
+            PROFILE_SCOPE("recordHandoff");
+            recorder.submit(frame, pose, slot.captureTime);
+        }
+
+        if (governor) {
+            governor->reportRender(drawMs);
+        }
+
+        // Drain the per-thread profile rings and append a summary every few seconds
+        profilerTick("profile_summary.csv", 5.0);
+
+        return key != 'q'; // Exit on 'q'
+    };
 
-        if (key == 'q') {
-            break; // Exit on 'q'
+    // Run capture, detection and rendering as overlapping stages unless the serial loop was requested
+    PipelineStats stats;
+    if (useSerialLoop) {
+        stats = runSerialLoop(cap, detectStage, renderStage);
+        printPipelineStats("serial", stats);
+    }
+    else {
+        stats = runPipelinedLoop(cap, detectStage, renderStage);
+        printPipelineStats("pipelined", stats);
+    }
+    if (useTracking) {
+        printTrackerStats(tracker.stats());
+    }
+    if (useFeatureTracking) {
+        printFeatureTrackerStats(featureTracker.stats());
+    }
+    printPoseStats(poseEstimator.stats());
+    printRasterStats(modelRasterizer.stats());
+    printSceneStats(scene.stats(), scene.instances().size());
+    printFrameAllocationStats("detect stage", detectAllocations, detectArena.stats());
+    printFrameAllocationStats("render stage", renderAllocations, renderArena.stats());
+    // Sessions stopped with 'r' already printed their stats
+    if (recorder.isRecording()) {
+        recorder.stop();
+        printRecorderStats(recorder.stats(), recorder.path());
+    }
+    if (governor) {
+        printFrameBudgetStats(*governor);
+    }
+    printUndistortStats(undistorter.stats());
+    printFeatureStats(featureDetector.stats(), featureDetector.gridSize());
+    for (int undistorted = 0; undistorted < 2; ++undistorted) {
+        if (poseTiming[undistorted].count > 0 || projectionTiming[undistorted].count > 0) {
+            std::cout << (undistorted ? "  undistorted frames:" : "  distorted frames:  ") << " solvePnP mean " << poseTiming[undistorted].meanMs()
+                << " ms, model projection mean " << projectionTiming[undistorted].meanMs() << " ms" << std::endl;
         }
     }
 
+    if (profileHasEvents()) {
+        writeChromeTrace("profile_trace.json");
+        writeProfileSummaryCsv("profile_summary.csv");
+        std::cout << "Profile written to profile_trace.json and profile_summary.csv" << std::endl;
+    }
+
     // Wait for the key input thread to finish
     if (keyInputThread.joinable()) {
         keyInputThread.join();